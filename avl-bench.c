@@ -0,0 +1,512 @@
+/*
+	avl-bench.c -- Benchmarks for the AVL tree.
+
+	Copyright (C) 2020 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include<pthread.h>
+#ifdef __GLIBC__
+#include<malloc.h>
+#endif
+#include"avl.h"
+#include"avl32.h"
+#include"avlpar.h"
+#include"avlc.h"
+#include"avlimg.h"
+
+static double now(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**	Same workload as avl-test (random unique inserts, then remove everything),
+	with a churn round in between. Pool is NULL for plain malloc mode.
+**/
+static void benchPool(struct avlPool *pool, const long *nums, size_t N){
+	Node *test = NULL;
+	double start, ins, churn, rem, dest;
+
+	start = now();
+	for(size_t i = 0;i < N;i++){
+		avlPoolInsert(pool, &test, nums[i]);
+	}
+	ins = now();
+
+	// Remove and re-insert every other key
+	for(size_t i = 0;i < N;i += 2){
+		avlPoolRemove(pool, &test, nums[i]);
+	}
+	for(size_t i = 0;i < N;i += 2){
+		avlPoolInsert(pool, &test, nums[i]);
+	}
+	churn = now();
+
+	// Remove half, and leave rest for destroy
+	for(size_t i = 0;i < N/2;i++){
+		avlPoolRemove(pool, &test, nums[i]);
+	}
+	rem = now();
+
+	if(pool != NULL) avlPoolDestroy(pool, &test);
+	else destroy(&test);
+	dest = now();
+
+	printf("%-8s insert %8.3fs  churn %8.3fs  remove %8.3fs  destroy %8.3fs  total %8.3fs\n",
+		(pool != NULL) ? "pool" : "malloc", ins - start, churn - ins, rem - churn, dest - rem, dest - start);
+}
+
+/**	Startup time of rebuilding from sorted snapshot, insert loop vs linear build
+**/
+static void benchBuild(size_t N){
+	long *keys = malloc(N * sizeof(*keys));
+	if(keys == NULL) return;
+	for(size_t i = 0;i < N;i++){
+		keys[i] = 2*i;
+	}
+
+	Node *test = NULL;
+	struct avlPool pool;
+	avlPoolInit(&pool, 0);
+	double start;
+
+	start = now();
+	for(size_t i = 0;i < N;i++){
+		avlInsert(&test, keys[i]);
+	}
+	printf("%-12s %8.3fs\n", "insert", now() - start);
+	destroy(&test);
+
+	start = now();
+	for(size_t i = 0;i < N;i++){
+		avlPoolInsert(&pool, &test, keys[i]);
+	}
+	printf("%-12s %8.3fs\n", "pool insert", now() - start);
+	avlPoolDestroy(&pool, &test);
+
+	start = now();
+	test = avlBuildSorted(keys, N);
+	printf("%-12s %8.3fs\n", "build", now() - start);
+	destroy(&test);
+
+	start = now();
+	test = avlPoolBuildSorted(&pool, keys, N);
+	printf("%-12s %8.3fs\n", "pool build", now() - start);
+	avlPoolDestroy(&pool, &test);
+
+	free(keys);
+}
+
+/**	Delete-heavy mixes on a tree of N keys. Each mix is drawn up front and
+	timed as a whole, then divided by the deletes in it. The 100% mix is
+	deletes only. Keys are fixed in this mode, so building with and without
+	-DREMOVE_ITER runs the same sequences against either remove.
+**/
+static void benchRemove(const long *nums, size_t N){
+	Node *test = NULL;
+	struct avlPool pool;
+	avlPoolInit(&pool, 0);
+	double start, elapsed;
+	size_t deletes;
+
+	long *ops = malloc(N * sizeof(*ops)); // Key to delete, or -1 - key to insert
+	if(ops == NULL) return;
+
+	const int pct[] = {100, 90, 75, 50}; // Percent of operations that delete
+	for(size_t p = 0;p < sizeof(pct)/sizeof(*pct);p++){
+		deletes = 0;
+		for(size_t i = 0;i < N;i++){
+			if((rand() % 100) < pct[p]) ops[i] = nums[deletes++];
+			else ops[i] = -1 - nums[rand() % N];
+		}
+
+		for(size_t i = 0;i < N;i++){
+			avlPoolInsert(&pool, &test, nums[i]);
+		}
+
+		start = now();
+		for(size_t i = 0;i < N;i++){
+			if(ops[i] >= 0) avlPoolRemove(&pool, &test, ops[i]);
+			else avlPoolInsert(&pool, &test, -1 - ops[i]);
+		}
+		elapsed = now() - start;
+
+		printf("%3d%% deletes: %10lu deletes  %8.1f ns/delete\n", pct[p], deletes, elapsed * 1e9 / deletes);
+		avlPoolDestroy(&pool, &test);
+	}
+
+	free(ops);
+}
+
+/**	Memory per key and insert/find time, pointer nodes vs compact nodes
+**/
+static void benchCompact(const long *nums, size_t N){
+	Node *test = NULL;
+	struct avlPool pool;
+	struct avl32 compact;
+	double start, ins, find;
+	size_t found = 0;
+	data_t *val;
+
+	avlPoolInit(&pool, 0);
+	avl32Init(&compact, 0);
+
+	// Malloc also pays for chunk header and rounding
+	size_t chunk = sizeof(Node);
+#ifdef __GLIBC__
+	void *probe = malloc(sizeof(Node));
+	chunk = malloc_usable_size(probe) + sizeof(size_t);
+	free(probe);
+#endif
+
+	start = now();
+	for(size_t i = 0;i < N;i++){
+		avlPoolInsert(&pool, &test, nums[i]);
+	}
+	ins = now();
+	for(size_t i = 0;i < N;i++){
+		found += avlFind(test, nums[i], &val);
+	}
+	find = now();
+	printf("%-8s %4lu B/node  malloc %6.1f B/key  pool %6.1f B/key  insert %8.3fs  find %8.3fs\n",
+		"pointer", sizeof(Node), (double)chunk, (double)sizeof(Node), ins - start, find - ins);
+	avlPoolDestroy(&pool, &test);
+
+	start = now();
+	for(size_t i = 0;i < N;i++){
+		avl32Insert(&compact, nums[i]);
+	}
+	ins = now();
+	for(size_t i = 0;i < N;i++){
+		found += avl32Find(&compact, nums[i], NULL);
+	}
+	find = now();
+	printf("%-8s %4lu B/node  arena  %6.1f B/key                  insert %8.3fs  find %8.3fs\n",
+		"compact", sizeof(struct avl32Node), (double)avl32Bytes(&compact) / avl32Size(&compact), ins - start, find - ins);
+	avl32Destroy(&compact);
+
+	if(found != 2*N) printf("WARNING: found %lu of %lu\n", found, 2*N);
+}
+
+/**	Scaling of parallel union and bulk build from 1 to maxThreads threads.
+	Union inputs are the multiples of 2 below 2N and of 3 below 3N, which share
+	the multiples of 6, about a third of either.
+**/
+static void benchParallel(size_t N, int maxThreads){
+	long *keys = malloc(2 * N * sizeof(*keys));
+	if(keys == NULL) return;
+
+	double start, base = 0;
+	for(int threads = 1;;threads *= 2){
+		if(threads > maxThreads) threads = maxThreads;
+		for(size_t i = 0;i < N;i++){
+			keys[i] = 2*i;
+			keys[N + i] = 3*i;
+		}
+		Node *a = avlBuildSorted(keys, N);
+		Node *b = avlBuildSorted(keys + N, N);
+
+		start = now();
+		Node *u = avlParUnion(a, b, threads);
+		double uni = now() - start;
+
+		start = now();
+		Node *built = avlParBuildSorted(keys, N, threads);
+		double build = now() - start;
+
+		if(threads == 1) base = uni + build;
+		printf("%3d threads  union %8.3fs  build %8.3fs  speedup %5.2fx\n", threads, uni, build, base / (uni + build));
+
+		if(size(built) != N) printf("WARNING: built %lu of %lu\n", size(built), N);
+		destroy(&u);
+		destroy(&built);
+
+		if(threads == maxThreads) break;
+	}
+
+	free(keys);
+}
+
+/**	Read/write mix from several threads, concurrent tree vs one global mutex
+	around the plain tree. Keys are drawn from [0, 2N) on a tree preloaded with N.
+**/
+struct concArgs{
+	struct avlc *conc;		// NULL for mutex mode
+	Node **tree;
+	pthread_mutex_t *lock;
+	int tid;
+	int readPct;
+	size_t ops;
+	size_t range;
+};
+
+static void *concWorker(void *arg){
+	struct concArgs *a = arg;
+	unsigned long x = a->tid * 2654435761UL + 1;
+	data_t *val;
+
+	for(size_t i = 0;i < a->ops;i++){
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+
+		long key = x % a->range;
+		int op = (x >> 32) % 100;
+		if(a->conc != NULL){
+			if(op < a->readPct) avlcFind(a->conc, a->tid, key);
+			else if(op & 1) avlcInsert(a->conc, a->tid, key);
+			else avlcRemove(a->conc, a->tid, key);
+		}else{
+			pthread_mutex_lock(a->lock);
+			if(op < a->readPct) avlFind(*a->tree, key, &val);
+			else if(op & 1) avlInsert(a->tree, key);
+			else avlRemove(a->tree, key);
+			pthread_mutex_unlock(a->lock);
+		}
+	}
+
+	return NULL;
+}
+
+static void benchConcurrent(size_t N, int maxThreads){
+	const int mixes[] = {100, 90, 50}; // Percent reads
+	const size_t ops = 1000000;
+
+	pthread_t *tids = malloc(maxThreads * sizeof(*tids));
+	struct concArgs *args = malloc(maxThreads * sizeof(*args));
+	if(tids == NULL || args == NULL) return;
+
+	for(size_t m = 0;m < sizeof(mixes)/sizeof(*mixes);m++){
+		for(int threads = 1;;threads *= 2){
+			if(threads > maxThreads) threads = maxThreads;
+
+			for(int mode = 0;mode < 2;mode++){
+				struct avlc conc;
+				Node *tree = NULL;
+				pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+				avlcInit(&conc, threads);
+				for(size_t i = 0;i < 2*N;i += 2){
+					if(mode) avlcInsert(&conc, 0, i);
+					else avlInsert(&tree, i);
+				}
+
+				double start = now();
+				for(int i = 0;i < threads;i++){
+					args[i] = (struct concArgs){(mode) ? &conc : NULL, &tree, &lock, i, mixes[m], ops, 2*N};
+					pthread_create(tids + i, NULL, concWorker, args + i);
+				}
+				for(int i = 0;i < threads;i++){
+					pthread_join(tids[i], NULL);
+				}
+				double elapsed = now() - start;
+
+				printf("%3d%% reads  %3d threads  %-6s %8.2f Mops/s\n", mixes[m], threads,
+					(mode) ? "avlc" : "mutex", threads * ops / elapsed / 1e6);
+
+				avlcDestroy(&conc);
+				destroy(&tree);
+			}
+
+			if(threads == maxThreads) break;
+		}
+	}
+
+	free(tids);
+	free(args);
+}
+
+/**	Random lookups (half hits) one at a time vs through avlFindBatch, for a
+	range of batch sizes. Tree should be well past LLC size to see a gain.
+**/
+void benchBatch(long *nums, size_t N){
+	Node *tree = NULL;
+	for(size_t i = 0;i < N;i++) avlInsert(&tree, nums[i]);
+
+	const size_t lookups = 4000000;
+	long *keys = malloc(lookups * sizeof(*keys));
+	int *res = malloc(lookups * sizeof(*res));
+	if(keys == NULL || res == NULL){
+		printf("Failed to allocate lookups\n");
+		free(keys);
+		free(res);
+		destroy(&tree);
+		return;
+	}
+	for(size_t i = 0;i < lookups;i++){
+		keys[i] = (rand() & 1) ? nums[rand() % N] : rand() % (N*3);
+	}
+
+	double start = now();
+	size_t hits = 0;
+	for(size_t i = 0;i < lookups;i++) hits += avlFind(tree, keys[i], NULL);
+	double elapsed = now() - start;
+	printf("loop      : %6.2f Mlookups/s (%lu hits)\n", lookups / elapsed / 1e6, hits);
+
+	const size_t batches[] = {16, 64, 256, 1024};
+	for(size_t b = 0;b < sizeof(batches) / sizeof(*batches);b++){
+		start = now();
+		for(size_t i = 0;i < lookups;i += batches[b]){
+			size_t n = (lookups - i < batches[b]) ? lookups - i : batches[b];
+			avlFindBatch(tree, keys + i, n, res + i);
+		}
+		elapsed = now() - start;
+
+		size_t batchHits = 0;
+		for(size_t i = 0;i < lookups;i++) batchHits += (res[i] != 0);
+		printf("batch %4lu: %6.2f Mlookups/s (%lu hits)%s\n", batches[b], lookups / elapsed / 1e6, batchHits,
+			(batchHits != hits) ? " MISMATCH" : "");
+	}
+
+	free(keys);
+	free(res);
+	destroy(&tree);
+}
+
+/**	Startup cost of re-inserting every key vs mapping a saved image, then
+	lookup and scan speed on the image compared to the heap tree.
+**/
+void benchImage(long *nums, size_t N){
+	const char *path = "avl-bench.img";
+	const size_t lookups = 4000000;
+
+	double start = now();
+	Node *tree = NULL;
+	for(size_t i = 0;i < N;i++) avlInsert(&tree, nums[i]);
+	printf("insert all: %8.3f ms\n", (now() - start) * 1e3);
+
+	start = now();
+	if(avlImgSave(tree, path)){
+		printf("Failed to save image\n");
+		destroy(&tree);
+		return;
+	}
+	printf("save      : %8.3f ms\n", (now() - start) * 1e3);
+
+	struct avlImg img;
+	start = now();
+	if(avlImgLoad(&img, path)){
+		printf("Failed to load image\n");
+		destroy(&tree);
+		remove(path);
+		return;
+	}
+	printf("load      : %8.3f ms\n", (now() - start) * 1e3);
+
+	size_t hits = 0;
+	start = now();
+	for(size_t i = 0;i < lookups;i++) hits += avlImgFind(&img, nums[rand() % N]);
+	printf("image find: %6.2f Mlookups/s (cold pages included, %lu hits)\n", lookups / (now() - start) / 1e6, hits);
+
+	hits = 0;
+	start = now();
+	for(size_t i = 0;i < lookups;i++) hits += avlFind(tree, nums[rand() % N], NULL);
+	printf("heap find : %6.2f Mlookups/s (%lu hits)\n", lookups / (now() - start) / 1e6, hits);
+
+	data_t *out = malloc(N * sizeof(*out));
+	if(out != NULL){
+		start = now();
+		size_t cnt = avlImgRange(&img, 0, 3*N, out, N);
+		printf("image scan: %6.2f Mitems/s (%lu items)\n", cnt / (now() - start) / 1e6, cnt);
+
+		struct avlIter it;
+		start = now();
+		avlIterBegin(&it, tree);
+		cnt = avlIterRange(&it, 3*N, out, N);
+		printf("heap scan : %6.2f Mitems/s (%lu items)\n", cnt / (now() - start) / 1e6, cnt);
+		free(out);
+	}
+
+	avlImgClose(&img);
+	destroy(&tree);
+	remove(path);
+}
+
+/**	Generate N unique random keys in [0, 3N), like avl-test does
+**/
+static long *genKeys(size_t N){
+	long *nums = malloc(N * sizeof(*nums));
+	if(nums == NULL) return NULL;
+
+	Node *seen = NULL;
+	for(size_t i = 0;i < N;i++){
+		nums[i] = rand() % (N*3);
+		if(avlInsert(&seen, nums[i])) --i; // Duplicate
+	}
+	destroy(&seen);
+
+	return nums;
+}
+
+int main(int argc, char *argv[]){
+	const char *mode = "pool";
+	size_t N = 1000000;
+	if(argc >= 2){
+		mode = argv[1];
+	}
+	if(argc >= 3){
+		N = strtol(argv[2], NULL, 10);
+	}
+
+	// Remove runs are compared between builds, so they get the same keys
+	srand((strcmp(mode, "remove")) ? time(0) : 1);
+
+	long *nums = genKeys(N);
+	if(nums == NULL){
+		printf("Failed to allocate keys\n");
+		return 1;
+	}
+
+	printf("Benchmarking %s with %lu keys..\n", mode, N);
+	if(!strcmp(mode, "pool")){
+		struct avlPool pool;
+		avlPoolInit(&pool, 0);
+
+		benchPool(NULL, nums, N);
+		benchPool(&pool, nums, N);
+	}else if(!strcmp(mode, "build")){
+		benchBuild(N);
+	}else if(!strcmp(mode, "remove")){
+#ifdef REMOVE_ITER
+		printf("Iterative remove\n");
+#else
+		printf("Recursive remove\n");
+#endif
+		benchRemove(nums, N);
+	}else if(!strcmp(mode, "compact")){
+		benchCompact(nums, N);
+	}else if(!strcmp(mode, "par")){
+		int threads = (argc >= 4) ? strtol(argv[3], NULL, 10) : 8;
+		benchParallel(N, (threads > 0) ? threads : 1);
+	}else if(!strcmp(mode, "conc")){
+		int threads = (argc >= 4) ? strtol(argv[3], NULL, 10) : 8;
+		benchConcurrent(N, (threads > 0) ? threads : 1);
+	}else if(!strcmp(mode, "batch")){
+		benchBatch(nums, N);
+	}else if(!strcmp(mode, "image")){
+		benchImage(nums, N);
+	}else{
+		printf("Unknown mode '%s'. Modes: pool build remove compact par conc batch image\n", mode);
+	}
+
+	free(nums);
+
+	return 0;
+}
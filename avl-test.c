@@ -18,8 +18,30 @@
 
 #include<stdio.h>
 #include<stdlib.h>
+#include<string.h>
 #include<time.h>
+#include<limits.h>
 #include"avl.h"
+#include"avl32.h"
+#include"avlpar.h"
+#include"avlc.h"
+#include"avlgen.h"
+#include"avlp.h"
+#include"avlimg.h"
+
+// Generated maps, one with a composite key
+struct pair{
+	long hi;
+	long lo;
+};
+
+static inline int cmpPair(struct pair a, struct pair b){
+	if(a.hi != b.hi) return (a.hi > b.hi) - (a.hi < b.hi);
+	return (a.lo > b.lo) - (a.lo < b.lo);
+}
+
+AVL_DEFINE(longMap, long, long, AVL_CMP_NUM)
+AVL_DEFINE(pairMap, struct pair, long, cmpPair)
 
 int checkAVL(Node *root){
 	if(root == NULL){
@@ -92,6 +114,732 @@ int checkAVL(Node *root){
 	return good;
 }
 
+/**	Checks tree holds exactly the keys set in in[0, M), and is balanced
+**/
+int checkPoolTree(Node *tree, const char *in, long M, const char *name){
+	size_t expect = 0;
+	data_t *val;
+	int good = checkAVL(tree);
+
+	for(long key = 0;key < M;key++){
+		expect += in[key];
+		if(!avlFind(tree, key, &val) != !in[key]){
+			printf("%s %s %ld\n", name, (in[key]) ? "lost" : "has extra", key);
+			good = -1;
+			break;
+		}
+	}
+	if(size(tree) != expect){
+		printf("%s has size %lu, expected %lu\n", name, size(tree), expect);
+		good = -1;
+	}
+
+	printf("%s is %s\n", name, (good)?"bad":"good");
+	return good;
+}
+
+/**	Random inserts and removes over keys [0, 2N) on a pool with small blocks,
+	then sorted builds and set operations in the same pool
+**/
+int checkPool(long N){
+	const long M = 2*N;
+	char *in = calloc(M, sizeof(*in));
+	char *want = calloc(M, sizeof(*want));
+	long *keys = malloc((M + N) * sizeof(*keys));
+	if(in == NULL || want == NULL || keys == NULL){
+		printf("Failed to allocate pool tables\n");
+		free(in);
+		free(want);
+		free(keys);
+		return -1;
+	}
+
+	struct avlPool pool;
+	avlPoolInit(&pool, 64); // Small, so churn goes through many blocks
+
+	Node *tree = NULL;
+	int ret = 0;
+	for(long i = 0;i < 4*N && !ret;i++){
+		long key = rand() % M;
+		if(rand() % 2){
+			if((avlPoolInsert(&pool, &tree, key) == 0) == in[key]){
+				printf("Pool insert of %ld disagrees, key was %s\n", key, (in[key]) ? "present" : "missing");
+				ret = -1;
+			}
+			in[key] = 1;
+		}else{
+			if((avlPoolRemove(&pool, &tree, key) == 0) != in[key]){
+				printf("Pool remove of %ld disagrees, key was %s\n", key, (in[key]) ? "present" : "missing");
+				ret = -1;
+			}
+			in[key] = 0;
+		}
+	}
+	ret |= checkPoolTree(tree, in, M, "Pool churn");
+
+	// Sorted builds take a block of their own. With the head block part
+	// used, that block is linked in behind it and the head stays current
+	long n = 0;
+	for(long key = 0;key < M;key++) if(in[key]) keys[n++] = key;
+	size_t used = pool.used, avail = pool.avail;
+	Node *built = avlPoolBuildSorted(&pool, keys, n);
+	if(used < avail && (pool.used != used || pool.avail != avail)){
+		printf("Pool build replaced the part used head block\n");
+		ret = -1;
+	}
+	ret |= checkPoolTree(built, in, M, "Pool build");
+
+	// Even keys go in from the head block and the free list
+	for(long key = 0;key < M;key++){
+		want[key] = in[key] || key % 2 == 0;
+		if(key % 2 == 0) avlPoolInsert(&pool, &built, key);
+	}
+	ret |= checkPoolTree(built, want, M, "Pool build after inserts");
+
+	avlPoolDestroy(&pool, &tree);
+	built = NULL; // Went with the blocks
+	if(pool.blocks != NULL || pool.free != NULL || tree != NULL){
+		printf("Pool still holds blocks after destroy\n");
+		ret = -1;
+	}
+
+	// Set operations on the emptied pool, with in[] as a and the even keys as b
+	for(long i = 0;i < N;i++) keys[n + i] = 2*i;
+	const char *names[] = {"Pool union", "Pool intersection", "Pool difference"};
+	for(int op = 0;op < 3;op++){
+		avlPoolInsert(&pool, &tree, -1); // Head block part used, builds go beside it
+		Node *a = avlPoolBuildSorted(&pool, keys, n);
+		Node *b = avlPoolBuildSorted(&pool, keys + n, N);
+		Node *res;
+		if(op == 0) res = avlPoolUnion(&pool, a, b);
+		else if(op == 1) res = avlPoolIntersect(&pool, a, b);
+		else res = avlPoolDifference(&pool, a, b);
+
+		for(long key = 0;key < M;key++){
+			int even = (key % 2 == 0);
+			want[key] = (op == 0) ? in[key] || even : in[key] && (op == 1) == even;
+		}
+		ret |= checkPoolTree(res, want, M, names[op]);
+		avlPoolDestroy(&pool, &res);
+		tree = NULL;
+	}
+
+	free(in);
+	free(want);
+	free(keys);
+
+	return ret;
+}
+
+/**	Returns height of compact subtree i, or -1 if it is broken
+**/
+int checkAVL32(const struct avl32 *t, uint32_t i, data_t lo, data_t hi){
+	if(i == 0) return 0;
+
+	const struct avl32Node *n = t->nodes + i;
+	uint32_t left = n->left & AVL32_IDX_MASK;
+	if(n->data <= lo || n->data >= hi){
+		printf("Node %u data %ld outside (%ld, %ld)\n", i, n->data, lo, hi);
+		return -1;
+	}
+
+	int lh = checkAVL32(t, left, lo, n->data);
+	int rh = checkAVL32(t, n->right, n->data, hi);
+	if(lh < 0 || rh < 0) return -1;
+
+	uint32_t bits = n->left >> 30;
+	int bal = (bits == 1) ? -1 : (bits == 2) ? 1 : 0;
+	if(rh - lh != bal){
+		printf("Node %u has balance %d, heights %d/%d\n", i, bal, lh, rh);
+		return -1;
+	}
+#ifdef AVL32_SIZE
+	uint32_t ls = (left) ? t->nodes[left].size : 0;
+	uint32_t rs = (n->right) ? t->nodes[n->right].size : 0;
+	if(n->size != ls + rs + 1){
+		printf("Node %u size %u != %u + %u + 1\n", i, n->size, ls, rs);
+		return -1;
+	}
+#endif
+
+	return ((lh > rh) ? lh : rh) + 1;
+}
+
+int cmpLong(const void *a, const void *b){
+	long x = *(const long *)a;
+	long y = *(const long *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**	Checks tree holds exactly the nums[i] with (i % 3) in mask, and is balanced
+**/
+int checkSet(Node *tree, const long *nums, long N, int mask, const char *name){
+	size_t expect = 0;
+	data_t *val;
+	int good = checkAVL(tree);
+
+	for(long i = 0;i < N;i++){
+		int in = (mask >> (i % 3)) & 1;
+		expect += in;
+		if(avlFind(tree, nums[i], &val) != in){
+			printf("%s %s %ld\n", name, (in) ? "lost" : "has extra", nums[i]);
+			good = -1;
+			break;
+		}
+	}
+	if(size(tree) != expect){
+		printf("%s has size %lu, expected %lu\n", name, size(tree), expect);
+		good = -1;
+	}
+
+	printf("%s is %s\n", name, (good)?"bad":"good");
+	return good;
+}
+
+/**	Split nums in three classes, a = {1,2} and b = {0,2}, and run set ops
+**/
+int checkSetOps(const long *nums, long N){
+	Node *a = NULL, *b = NULL;
+	int ret = 0;
+
+	for(long i = 0;i < N;i++){
+		if(i % 3 != 0) avlInsert(&a, nums[i]);
+		if(i % 3 != 1) avlInsert(&b, nums[i]);
+	}
+	Node *u = avlUnion(a, b);
+	ret |= checkSet(u, nums, N, 7, "Union");
+
+	// Split union back apart around a middle key
+	Node *left, *right;
+	Node *mid = avlSplit(u, nums[N/2], &left, &right);
+	if(mid == NULL || mid->data != nums[N/2] || size(left) + size(right) + 1 != N || max(left) >= nums[N/2] || min(right) <= nums[N/2]){
+		printf("Split at %ld is bad\n", nums[N/2]);
+		ret = -1;
+	}
+	free(mid);
+	destroy(&left);
+	destroy(&right);
+
+	a = NULL;
+	b = NULL;
+	for(long i = 0;i < N;i++){
+		if(i % 3 != 0) avlInsert(&a, nums[i]);
+		if(i % 3 != 1) avlInsert(&b, nums[i]);
+	}
+	u = avlParUnion(a, b, 4);
+	ret |= checkSet(u, nums, N, 7, "Parallel union");
+	destroy(&u);
+
+	a = NULL;
+	b = NULL;
+	for(long i = 0;i < N;i++){
+		if(i % 3 != 0) avlInsert(&a, nums[i]);
+		if(i % 3 != 1) avlInsert(&b, nums[i]);
+	}
+	Node *in = avlIntersect(a, b);
+	ret |= checkSet(in, nums, N, 4, "Intersection");
+	destroy(&in);
+
+	a = NULL;
+	b = NULL;
+	for(long i = 0;i < N;i++){
+		if(i % 3 != 0) avlInsert(&a, nums[i]);
+		if(i % 3 != 1) avlInsert(&b, nums[i]);
+	}
+	Node *diff = avlDifference(a, b);
+	ret |= checkSet(diff, nums, N, 2, "Difference");
+	destroy(&diff);
+
+	return ret;
+}
+
+// Return 0 if both trees hold the same items
+int sameItems(const Node *x, const Node *y){
+	struct avlIter a, b;
+	data_t va, vb;
+	int hasA, hasB;
+
+	avlIterBegin(&a, x);
+	avlIterBegin(&b, y);
+	do{
+		hasA = avlIterNext(&a, &va);
+		hasB = avlIterNext(&b, &vb);
+		if(hasA != hasB || (hasA && va != vb)) return -1;
+	}while(hasA);
+
+	return 0;
+}
+
+int keepEven(data_t data, void *arg){
+	(void)arg;
+	return (data % 2 == 0);
+}
+
+/**	Each parallel operation against its sequential version at a few thread
+	counts, including more threads than there are forks to steal.
+**/
+int checkParOps(const long *nums, long N){
+	const int threads[] = {1, 2, 3, 8};
+	const char *names[] = {"intersection", "difference", "filter", "build"};
+	long *sorted = malloc(N * sizeof(*sorted));
+	Node *a, *b, *par, *seq;
+	int ret = 0;
+
+	memcpy(sorted, nums, N * sizeof(*sorted));
+	qsort(sorted, N, sizeof(*sorted), cmpLong);
+
+	for(int t = 0;t < 4 && !ret;t++){
+		for(int op = 0;op < 4 && !ret;op++){
+			par = seq = NULL;
+			if(op < 2){
+				for(int k = 0;k < 2;k++){
+					a = NULL;
+					b = NULL;
+					for(long i = 0;i < N;i++){
+						if(i % 3 != 0) avlInsert(&a, nums[i]);
+						if(i % 3 != 1) avlInsert(&b, nums[i]);
+					}
+					if(k) seq = (op) ? avlDifference(a, b) : avlIntersect(a, b);
+					else par = (op) ? avlParDifference(a, b, threads[t]) : avlParIntersect(a, b, threads[t]);
+				}
+			}else if(op == 2){
+				for(long i = 0;i < N;i++){
+					avlInsert(&par, nums[i]);
+					if(keepEven(nums[i], NULL)) avlInsert(&seq, nums[i]);
+				}
+				par = avlParFilter(par, keepEven, NULL, threads[t]);
+			}else{
+				par = avlParBuildSorted(sorted, N, threads[t]);
+				seq = avlBuildSorted(sorted, N);
+			}
+
+			if(checkAVL(par) || size(par) != size(seq) || sameItems(par, seq)){
+				printf("Parallel %s with %d threads disagrees\n", names[op], threads[t]);
+				ret = -1;
+			}
+			destroy(&par);
+			destroy(&seq);
+		}
+	}
+
+	printf("Parallel operations are %s\n", (ret)?"bad":"good");
+	free(sorted);
+
+	return ret;
+}
+
+/**	Readers run while two writers churn the odd multiples of 2, each writer
+	its own half of them. Multiples of 4 are always present and odd numbers
+	never are, so readers can check both. Writers check their own keys.
+**/
+#define CONC_RANGE 40000
+struct avlc conc;
+atomic_int concStop;
+atomic_long concBad;
+char concIn[CONC_RANGE];
+
+void *concReader(void *arg){
+	int tid = (long)arg;
+	unsigned x = tid * 7919 + 1;
+
+	while(!atomic_load(&concStop)){
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+
+		long key = x % CONC_RANGE;
+		int found = avlcFind(&conc, tid, key);
+		if((key % 4 == 0 && !found) || (key % 2 == 1 && found)) atomic_fetch_add(&concBad, 1);
+	}
+
+	return NULL;
+}
+
+struct concWriterArgs{
+	int tid;
+	int half;
+	long ops;
+};
+
+void *concWriter(void *arg){
+	struct concWriterArgs *a = arg;
+	unsigned x = a->tid * 31 + 7;
+
+	for(long i = 0;i < a->ops;i++){
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+
+		long key = ((x % (CONC_RANGE / 8)) * 2 + a->half) * 4 + 2;
+		if(x & (1 << 20)){
+			if((avlcInsert(&conc, a->tid, key) == 0) == concIn[key]) atomic_fetch_add(&concBad, 1);
+			concIn[key] = 1;
+		}else{
+			if((avlcRemove(&conc, a->tid, key) == 0) != concIn[key]) atomic_fetch_add(&concBad, 1);
+			concIn[key] = 0;
+		}
+	}
+
+	return NULL;
+}
+
+/**	Once quiet: order, parent links, balance. Returns height, -1 if bad
+**/
+int checkAVLC(const struct avlcNode *n, const struct avlcNode *parent, long lo, long hi){
+	if(n == NULL) return 0;
+
+	if(n->data <= lo || n->data >= hi || atomic_load(&n->parent) != parent || (atomic_load(&n->version) & 3)){
+		printf("Concurrent node %ld is misplaced or still flagged\n", n->data);
+		return -1;
+	}
+
+	int left = checkAVLC(atomic_load(&n->child[0]), n, lo, n->data);
+	int right = checkAVLC(atomic_load(&n->child[1]), n, n->data, hi);
+	if(left < 0 || right < 0) return -1;
+	if(left - right > 1 || right - left > 1){
+		printf("Concurrent node %ld is unbalanced, %d vs %d\n", n->data, left, right);
+		return -1;
+	}
+
+	return ((left > right) ? left : right) + 1;
+}
+
+int checkConcurrent(long N){
+	pthread_t readers[3], writers[2];
+	struct concWriterArgs args[2];
+	int ret = 0;
+
+	avlcInit(&conc, 5);
+	memset(concIn, 0, sizeof(concIn));
+	for(long k = 0;k < CONC_RANGE;k += 4){
+		avlcInsert(&conc, 0, k);
+	}
+
+	for(long i = 0;i < 3;i++){
+		pthread_create(readers + i, NULL, concReader, (void *)i);
+	}
+	for(int i = 0;i < 2;i++){
+		args[i] = (struct concWriterArgs){3 + i, i, 2*N};
+		pthread_create(writers + i, NULL, concWriter, args + i);
+	}
+	for(int i = 0;i < 2;i++){
+		pthread_join(writers[i], NULL);
+	}
+	atomic_store(&concStop, 1);
+	for(int i = 0;i < 3;i++){
+		pthread_join(readers[i], NULL);
+	}
+
+	if(atomic_load(&concBad)){
+		printf("Readers and writers saw %ld wrong results\n", atomic_load(&concBad));
+		ret = -1;
+	}
+	size_t expect = 0;
+	for(long k = 0;k < CONC_RANGE && !ret;k++){
+		int in = (k % 4 == 0) || concIn[k];
+		expect += in;
+		if(avlcFind(&conc, 0, k) != in){
+			printf("Concurrent tree %s %ld\n", (in) ? "lost" : "has extra", k);
+			ret = -1;
+		}
+	}
+	if(!ret && checkAVLC(atomic_load(&conc.holder.child[1]), &conc.holder, -1, LONG_MAX) < 0) ret = -1;
+	if(!ret && avlcSize(&conc) != expect){
+		printf("Concurrent tree has size %lu, expected %lu\n", avlcSize(&conc), expect);
+		ret = -1;
+	}
+	printf("Concurrent tree is %s\n", (ret)?"bad":"good");
+	avlcDestroy(&conc);
+
+	return ret;
+}
+
+/**	Returns height of generated subtree, or -1 if it is broken
+**/
+int checkLongMap(const struct longMap_node *n){
+	if(n == NULL) return 0;
+
+	int left = checkLongMap(n->left);
+	int right = checkLongMap(n->right);
+	if(left < 0 || right < 0) return -1;
+	if((n->left != NULL && n->left->key >= n->key) || (n->right != NULL && n->right->key <= n->key)
+		|| left - right > 1 || right - left > 1 || n->height != ((left > right) ? left : right) + 1
+		|| n->size != longMap_nodeSize(n->left) + longMap_nodeSize(n->right) + 1){
+		printf("Generated node %ld is broken\n", n->key);
+		return -1;
+	}
+
+	return n->height;
+}
+
+int checkGenerated(const long *nums, long N){
+	struct longMap map = {NULL};
+	struct pairMap pairs = {NULL};
+	int ret = 0;
+
+	for(long i = 0;i < N;i++){
+		if(longMap_insert(&map, nums[i], -nums[i]) || pairMap_insert(&pairs, (struct pair){nums[i] % 7, nums[i]}, i)){
+			printf("Generated insert of %ld failed\n", nums[i]);
+			ret = -1;
+			break;
+		}
+	}
+	if(!longMap_insert(&map, nums[0], 0)) printf("Generated map took duplicate %ld\n", nums[0]);
+
+	for(long i = 0;i < N/2 && !ret;i++){
+		long val;
+		if(longMap_remove(&map, nums[i], &val) || val != -nums[i] || pairMap_remove(&pairs, (struct pair){nums[i] % 7, nums[i]}, NULL)){
+			printf("Generated remove of %ld failed\n", nums[i]);
+			ret = -1;
+		}
+	}
+	for(long i = 0;i < N && !ret;i++){
+		long *val = longMap_find(&map, nums[i]);
+		long *idx = pairMap_find(&pairs, (struct pair){nums[i] % 7, nums[i]});
+		if((i < N/2) != (val == NULL) || (val != NULL && *val != -nums[i]) || (idx != NULL && *idx != i) || (val == NULL) != (idx == NULL)){
+			printf("Generated find of %ld is wrong\n", nums[i]);
+			ret = -1;
+		}
+	}
+	if(!ret && (checkLongMap(map.root) < 0 || longMap_size(&map) != N - N/2 || pairMap_size(&pairs) != N - N/2)){
+		printf("Generated map has bad shape or size %lu\n", longMap_size(&map));
+		ret = -1;
+	}
+
+	printf("Generated maps are %s\n", (ret)?"bad":"good");
+	longMap_destroy(&map);
+	pairMap_destroy(&pairs);
+
+	return ret;
+}
+
+/**	Returns height of persistent subtree, or -1 if it is broken
+**/
+int checkAVLP(const struct avlpNode *n){
+	if(n == NULL) return 0;
+
+	int left = checkAVLP(n->left);
+	int right = checkAVLP(n->right);
+	if(left < 0 || right < 0) return -1;
+	if((n->left != NULL && n->left->data >= n->data) || (n->right != NULL && n->right->data <= n->data)
+		|| left - right > 1 || right - left > 1 || n->height != ((left > right) ? left : right) + 1
+		|| n->size != avlpSize(n->left) + avlpSize(n->right) + 1){
+		printf("Persistent node %ld is broken\n", n->data);
+		return -1;
+	}
+
+	return n->height;
+}
+
+/**	Keep a snapshot from the middle of the inserts and one before removes,
+	then make sure later updates don't show up in either.
+**/
+int checkPersistent(const long *nums, long N){
+	struct avlp tree;
+	struct avlpNode *half = NULL, *full = NULL;
+	int ret = 0;
+
+	avlpTreeInit(&tree);
+	for(long i = 0;i < N;i++){
+		if(i == N/2) half = avlpTreeSnapshot(&tree);
+		if(avlpTreeInsert(&tree, nums[i])){
+			printf("Persistent insert of %ld failed\n", nums[i]);
+			ret = -1;
+			break;
+		}
+	}
+	full = avlpTreeSnapshot(&tree);
+	for(long i = 0;i < N;i += 2){
+		avlpTreeRemove(&tree, nums[i]);
+	}
+
+	struct avlpNode *now = avlpTreeSnapshot(&tree);
+	for(long i = 0;i < N && !ret;i++){
+		if(avlpFind(half, nums[i]) != (i < N/2) || !avlpFind(full, nums[i]) || avlpFind(now, nums[i]) != (i % 2)){
+			printf("Persistent snapshots disagree on %ld\n", nums[i]);
+			ret = -1;
+		}
+	}
+	if(!ret && (checkAVLP(half) < 0 || checkAVLP(full) < 0 || checkAVLP(now) < 0
+		|| avlpSize(half) != N/2 || avlpSize(full) != N || avlpSize(now) != N/2)){
+		printf("Persistent snapshots have bad shape or size\n");
+		ret = -1;
+	}
+
+	printf("Persistent snapshots are %s\n", (ret)?"bad":"good");
+	avlpRelease(half);
+	avlpRelease(full);
+	avlpRelease(now);
+	avlpTreeDestroy(&tree);
+
+	return ret;
+}
+
+/**	Readers keep pinning snapshots while the main thread churns the odd keys.
+	Each snapshot has to be a whole version still holding every even key.
+**/
+#define PERSIST_RANGE 2000
+struct avlp persist;
+atomic_int persistStop;
+atomic_long persistBad;
+
+void *persistReader(void *arg){
+	(void)arg;
+
+	while(!atomic_load(&persistStop)){
+		struct avlpNode *snap = avlpTreeSnapshot(&persist);
+		if(checkAVLP(snap) < 0) atomic_fetch_add(&persistBad, 1);
+		for(long key = 0;key < PERSIST_RANGE;key += 2){
+			if(!avlpFind(snap, key)){
+				atomic_fetch_add(&persistBad, 1);
+				break;
+			}
+		}
+		avlpRelease(snap);
+	}
+
+	return NULL;
+}
+
+int checkSharedSnapshots(long N){
+	pthread_t readers[2];
+	int ret = 0;
+
+	avlpTreeInit(&persist);
+	atomic_store(&persistStop, 0);
+	atomic_store(&persistBad, 0);
+	for(long key = 0;key < PERSIST_RANGE;key += 2) avlpTreeInsert(&persist, key);
+
+	for(long i = 0;i < 2;i++){
+		pthread_create(readers + i, NULL, persistReader, NULL);
+	}
+	for(long i = 0;i < N;i++){
+		long key = (rand() % (PERSIST_RANGE / 2)) * 2 + 1;
+		if(rand() % 2) avlpTreeInsert(&persist, key);
+		else avlpTreeRemove(&persist, key);
+	}
+	atomic_store(&persistStop, 1);
+	for(long i = 0;i < 2;i++){
+		pthread_join(readers[i], NULL);
+	}
+
+	if(atomic_load(&persistBad)){
+		printf("Readers pinned %ld broken snapshots\n", atomic_load(&persistBad));
+		ret = -1;
+	}
+
+	printf("Shared snapshots are %s\n", (ret)?"bad":"good");
+	avlpTreeDestroy(&persist);
+
+	return ret;
+}
+
+/**	Save a tree, map it back, and compare finds and range scans against the
+	heap tree, before and after changes on top of the image.
+**/
+int checkImage(const long *nums, long N){
+	const char *path = "avl-test.img";
+	Node *tree = NULL;
+	struct avlImg img;
+	int ret = 0;
+
+	for(long i = 0;i < N;i++) avlInsert(&tree, nums[i]);
+	if(avlImgSave(tree, path) || avlImgLoad(&img, path)){
+		printf("Image save or load failed\n");
+		destroy(&tree);
+		remove(path);
+		return -1;
+	}
+
+	// Change a third of the keys, mirrored in the heap tree
+	for(long i = 0;i < N;i += 3){
+		if(avlImgRemove(&img, nums[i]) || avlImgInsert(&img, nums[i] + 3*N)){
+			printf("Image update at %ld failed\n", nums[i]);
+			ret = -1;
+			break;
+		}
+		avlRemove(&tree, nums[i]);
+		avlInsert(&tree, nums[i] + 3*N);
+	}
+	if(!ret && (avlImgInsert(&img, nums[1]) == 0 || avlImgRemove(&img, nums[0]) == 0)){
+		printf("Image accepted duplicate insert or missing remove\n");
+		ret = -1;
+	}
+
+	for(long i = -1;i <= 6*N && !ret;i++){
+		if(avlImgFind(&img, i) != avlFind(tree, i, NULL)){
+			printf("Image find of %ld disagrees\n", i);
+			ret = -1;
+		}
+	}
+
+	long *a = malloc(N * sizeof(*a)), *b = malloc(N * sizeof(*b));
+	struct avlIter it;
+	for(int k = 0;k < 100 && !ret;k++){
+		long lo = rand() % (6*N), hi = lo + rand() % N;
+		size_t max = 1 + rand() % N;
+		avlIterSeek(&it, tree, lo);
+		size_t cnt = avlIterRange(&it, hi, b, max);
+		if(avlImgRange(&img, lo, hi, a, max) != cnt || memcmp(a, b, cnt * sizeof(*a))){
+			printf("Image range [%ld, %ld) disagrees\n", lo, hi);
+			ret = -1;
+		}
+	}
+	if(!ret && avlImgSize(&img) != size(tree)){
+		printf("Image has size %lu, expected %lu\n", avlImgSize(&img), size(tree));
+		ret = -1;
+	}
+
+	avlImgClose(&img);
+
+	// Links out of the image or pointing back must not load
+	const uint64_t bad[] = {0, 2, size(tree), (uint64_t)-1};
+	struct avlImgNode node;
+	FILE *fp;
+	for(int k = 0;k < 4 && !ret;k++){
+		ret = avlImgSave(tree, path);
+		fp = fopen(path, "r+b");
+		if(ret || fp == NULL){
+			ret = -1;
+			break;
+		}
+		long at = sizeof(struct avlImgHeader) + (rand() % N) * sizeof(node);
+		fseek(fp, at, SEEK_SET);
+		fread(&node, sizeof(node), 1, fp);
+		if(k & 1) node.left = bad[k];
+		else node.right = (node.right) ? bad[k] : bad[k+1];
+		fseek(fp, at, SEEK_SET);
+		fwrite(&node, sizeof(node), 1, fp);
+		fclose(fp);
+
+		if(avlImgLoad(&img, path) == 0){
+			printf("Image with a bad link loaded\n");
+			avlImgClose(&img);
+			ret = -1;
+		}
+	}
+
+	// Well linked but unbalanced, the iterators would run out of stack
+	struct node vine[3] = {
+		{.data = 1, .size = 3, .height = 3, .right = vine + 1},
+		{.data = 2, .size = 2, .height = 2, .right = vine + 2},
+		{.data = 3, .size = 1, .height = 1}
+	};
+	if(!ret && (avlImgSave(vine, path) || avlImgLoad(&img, path) == 0)){
+		printf("Unbalanced image loaded\n");
+		ret = -1;
+	}
+
+	printf("Image is %s\n", (ret)?"bad":"good");
+	free(a);
+	free(b);
+	destroy(&tree);
+	remove(path);
+
+	return ret;
+}
+
 int main(int argc, char *argv[]){
 	srand(time(0));
 
@@ -140,7 +888,137 @@ int main(int argc, char *argv[]){
 		}
 	}
 
-	free(nums);
+	// Same churn on a pooled tree
+	printf("\nChecking node pool..\n");
+	checkPool(N);
+	printf("\n");
+
+	// Rebuild from sorted copy of the keys
+	printf("Building tree from sorted keys..\n");
+	qsort(nums, N, sizeof(*nums), cmpLong);
+	test = avlBuildSorted(nums, N);
+	ret = checkAVL(test);
+	if(test == NULL || test->size != N){
+		printf("Built tree has size %lu, expected %lu\n", (test == NULL) ? 0 : test->size, N);
+		ret = -1;
+	}
+	printf("Built tree is %s\n\n", (ret)?"bad":"good");
+
+	// Sorted keys give expected order statistics
+	printf("Checking select/rank..\n");
+	data_t val;
+	for(long i = 0;i < N;i++){
+		if(!avlSelect(test, i, &val) || val != nums[i]){
+			printf("Select %ld gave %ld, expected %ld\n", i, val, nums[i]);
+			break;
+		}else if(avlRank(test, nums[i]) != i){
+			printf("Rank of %ld gave %lu, expected %ld\n", nums[i], avlRank(test, nums[i]), i);
+			break;
+		}
+	}
+
+	// Cursor should walk the sorted keys both ways
+	printf("Checking cursor..\n");
+	struct avlIter it;
+	long i = 0;
+	for(avlIterBegin(&it, test);avlIterNext(&it, &val);i++){
+		if(i >= N || val != nums[i]){
+			printf("Cursor gave %ld at %ld, expected %ld\n", val, i, (i < N) ? nums[i] : -1);
+			break;
+		}
+	}
+	if(i != N) printf("Cursor stopped at %ld of %lu\n", i, N);
+	for(avlIterSeek(&it, test, nums[N-1]), i = N-1;avlIterPrev(&it, &val);i--){
+		if(i < 0 || val != nums[i]){
+			printf("Reverse cursor gave %ld at %ld\n", val, i);
+			break;
+		}
+	}
+
+	// Range [nums[N/4], nums[N/2]) in small batches
+	data_t batch[7];
+	size_t got, total = 0;
+	avlIterSeek(&it, test, nums[N/4]);
+	while((got = avlIterRange(&it, nums[N/2], batch, 7)) > 0){
+		for(size_t j = 0;j < got;j++){
+			if(batch[j] != nums[N/4 + total + j]) printf("Range gave %ld, expected %ld\n", batch[j], nums[N/4 + total + j]);
+		}
+		total += got;
+	}
+	if(total != N/2 - N/4) printf("Range gave %lu items, expected %lu\n", total, N/2 - N/4);
+
+	if(avlSelect(test, N, &val)){
+		printf("Select past end succeeded\n");
+	}
+	if(N > 1 && avlCountRange(test, nums[0], nums[N-1]) != N-1){
+		printf("Range count gave %lu, expected %lu\n", avlCountRange(test, nums[0], nums[N-1]), N-1);
+	}
+
 	printf("Destroying..\n");
 	destroy(&test);
+
+	// Same inserts and removes on the compact tree
+	printf("\nChecking compact tree..\n");
+	for(long i = N-1;i > 0;i--){ // Shuffle keys back up
+		long j = rand() % (i+1);
+		long tmp = nums[i];
+		nums[i] = nums[j];
+		nums[j] = tmp;
+	}
+
+	struct avl32 compact;
+	avl32Init(&compact, 0);
+	for(long i = 0;i < N;i++){
+		if(avl32Insert(&compact, nums[i])){
+			printf("Compact insert of %ld failed\n", nums[i]);
+			break;
+		}
+	}
+	ret = checkAVL32(&compact, compact.root, LONG_MIN, LONG_MAX) < 0;
+	for(long i = 0;i < N && !ret;i++){
+		if(!avl32Find(&compact, nums[i], NULL)){
+			printf("Compact tree lost %ld\n", nums[i]);
+			ret = -1;
+		}
+	}
+	for(long i = 0;i < N/2 && !ret;i++){
+		if(avl32Remove(&compact, nums[i])){
+			printf("Compact remove of %ld failed\n", nums[i]);
+			ret = -1;
+		}else if(i % 64 == 0 && checkAVL32(&compact, compact.root, LONG_MIN, LONG_MAX) < 0){
+			printf("Compact tree failed check after removing %ld\n", nums[i]);
+			ret = -1;
+		}
+	}
+	for(long i = 0;i < N && !ret;i++){
+		if(avl32Find(&compact, nums[i], NULL) != (i >= N/2)){
+			printf("Compact find of %ld is wrong after removes\n", nums[i]);
+			ret = -1;
+		}
+	}
+	if(!ret && avl32Size(&compact) != N - N/2){
+		printf("Compact tree has size %lu, expected %lu\n", avl32Size(&compact), N - N/2);
+		ret = -1;
+	}
+	printf("Compact tree is %s\n", (ret)?"bad":"good");
+	avl32Destroy(&compact);
+
+	printf("\nChecking set operations..\n");
+	checkSetOps(nums, N);
+	checkParOps(nums, N);
+
+	printf("\nChecking generated maps..\n");
+	checkGenerated(nums, N);
+
+	printf("\nChecking persistent snapshots..\n");
+	checkPersistent(nums, N);
+	checkSharedSnapshots(N);
+
+	printf("\nChecking mapped image..\n");
+	checkImage(nums, N);
+
+	printf("\nChecking concurrent tree..\n");
+	checkConcurrent(N);
+
+	free(nums);
 }
@@ -18,6 +18,89 @@
 
 #include"avl.h"
 
+#ifdef __GNUC__
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr)
+#endif
+
+/**	Allocate a block of count nodes (plus link node) and add it to the pool.
+	Marks take nodes as used, returning the first of them.
+	A partially used head block stays current, so its spare nodes aren't lost.
+**/
+static struct node *newBlock(struct avlPool *pool, size_t count, size_t take){
+	// First node of each block is the link to the next block
+	size_t bytes = (count + 1) * sizeof(struct node);
+	bytes = (bytes + AVL_POOL_ALIGN - 1) & ~(size_t)(AVL_POOL_ALIGN - 1);
+
+	struct node *block = aligned_alloc(AVL_POOL_ALIGN, bytes);
+	if(block == NULL) return NULL;
+
+	if(pool->blocks != NULL && pool->used < pool->avail){
+		block->left = pool->blocks->left;
+		pool->blocks->left = block;
+	}else{
+		block->left = pool->blocks;
+		pool->blocks = block;
+		pool->used = 1 + take;
+		pool->avail = bytes / sizeof(struct node);
+	}
+
+	return block + 1;
+}
+
+/**	Grab a node from the pool, or malloc when no pool is given.
+	Pool takes from free list first, then from the head block, then a new block.
+**/
+static struct node *newNode(struct avlPool *pool, data_t data){
+	struct node *ret = NULL;
+
+	if(pool == NULL){
+		ret = malloc(sizeof(*ret));
+	}else if(pool->free != NULL){
+		ret = pool->free;
+		pool->free = ret->left;
+	}else if(pool->used < pool->avail){
+		ret = pool->blocks + pool->used++;
+	}else{
+		ret = newBlock(pool, pool->blockSize, 1);
+	}
+
+	if(ret == NULL) return NULL;
+
+	ret->data = data;
+	ret->size = 1;
+	ret->height = 1;
+	ret->left = NULL;
+	ret->right = NULL;
+
+	return ret;
+}
+
+/**	Return node to pool free list, or free when no pool is given
+**/
+static inline void freeNode(struct avlPool *pool, struct node *old){
+	if(pool == NULL){
+		free(old);
+		return;
+	}
+
+	old->left = pool->free;
+	pool->free = old;
+}
+
+int avlPoolInit(struct avlPool *pool, size_t blockSize){
+	if(pool == NULL) return -1;
+
+	pool->blocks = NULL;
+	pool->free = NULL;
+	pool->used = 0;
+	pool->avail = 0;
+	pool->blockSize = (blockSize) ? blockSize : AVL_POOL_BLOCK;
+
+	return 0;
+}
+
 /**	Calculate height of given node
 	(Can return size_t, but nothing currently uses return)
 **/
@@ -138,7 +221,7 @@ int rotate(struct node **tree){
 
 /**	Inserts data into tree, performs rotations and updates heights
 **/
-int avlInsert(struct node **tree, data_t data){
+int avlPoolInsert(struct avlPool *pool, struct node **tree, data_t data){
 	int ret = -1;
 	if(tree == NULL) return ret;
 
@@ -147,21 +230,15 @@ int avlInsert(struct node **tree, data_t data){
 	*/
 	if(*tree == NULL){
 		//printf("Inserting %d\n", data);
-		(*tree) = malloc(sizeof(Node));// Once at end of branch, insert leaf
-		(*tree)->data = data;
-		(*tree)->size = 1;
-		(*tree)->height = 1;
-		(*tree)->left = NULL;
-		(*tree)->right = NULL;
-
-		ret = 0;
+		(*tree) = newNode(pool, data);// Once at end of branch, insert leaf
+		ret = ((*tree) == NULL) ? -1 : 0;
 	}else{
 		if((*tree)->data == data){
 			ret = -1; // If data already exists
 		}else if((*tree)->data > data){
-			ret = avlInsert(&((*tree)->left), data); // Recurse to add
+			ret = avlPoolInsert(pool, &((*tree)->left), data); // Recurse to add
 		}else if((*tree)->data < data){
-			ret = avlInsert(&((*tree)->right), data);
+			ret = avlPoolInsert(pool, &((*tree)->right), data);
 		}
 
 		// Update node data on successful insert
@@ -194,12 +271,8 @@ int avlInsert(struct node **tree, data_t data){
 	}
 
 	// Insert the node
-	(*root) = malloc(sizeof(Node));
-	(*root)->data = data;
-	(*root)->size = 1;
-	(*root)->height = 1;
-	(*root)->left = NULL;
-	(*root)->right = NULL;
+	(*root) = newNode(pool, data);
+	if((*root) == NULL) return -1;
 
 	// Reverse path to update height and rotate
 	while(--cnt >= 0){
@@ -219,10 +292,69 @@ int avlInsert(struct node **tree, data_t data){
 	return ret;
 }
 
-data_t avlDeleteMin(struct node **tree){
+int avlInsert(struct node **tree, data_t data){
+	return avlPoolInsert(NULL, tree, data);
+}
+
+/**	Builds perfectly balanced subtree from n sorted keys, middle key as root.
+	When base is given, nodes are taken from it in key order (no allocation).
+**/
+static struct node *buildSorted(struct avlPool *pool, struct node *base, const data_t *keys, size_t n){
+	if(n == 0) return NULL;
+
+	size_t mid = n / 2;
+	struct node *root = (base != NULL) ? base + mid : newNode(pool, keys[mid]);
+	if(root == NULL) return NULL;
+
+	root->data = keys[mid];
+	root->left = buildSorted(pool, base, keys, mid);
+	root->right = buildSorted(pool, (base != NULL) ? base + mid + 1 : NULL, keys + mid + 1, n - mid - 1);
+
+	// Only malloc mode can fail, so drop partial subtrees
+	if((mid && root->left == NULL) || ((n - mid - 1) && root->right == NULL)){
+		destroy(&root->left);
+		destroy(&root->right);
+		free(root);
+		return NULL;
+	}
+
+	size_t left = (root->left != NULL) ? root->left->height : 0;
+	size_t right = (root->right != NULL) ? root->right->height : 0;
+	root->height = ((left > right) ? left : right) + 1;
+	root->size = n;
+
+	return root;
+}
+
+struct node *avlPoolBuildSorted(struct avlPool *pool, const data_t *keys, size_t n){
+	if(keys == NULL || n == 0) return NULL;
+
+	// Keys must be strictly increasing
+	for(size_t i = 1;i < n;i++){
+		if(keys[i-1] >= keys[i]) return NULL;
+	}
+
+	// Pool gets all nodes in one contiguous block
+	struct node *base = NULL;
+	if(pool != NULL){
+		base = newBlock(pool, n, n);
+		if(base == NULL) return NULL;
+	}
+
+	return buildSorted(pool, base, keys, n);
+}
+
+struct node *avlBuildSorted(const data_t *keys, size_t n){
+	return avlPoolBuildSorted(NULL, keys, n);
+}
+
+#ifndef REMOVE_ITER
+/*	Typical recursive variant
+*/
+data_t avlDeleteMin(struct avlPool *pool, struct node **tree){
 	if((*tree) != NULL){
 		if((*tree)->left != NULL){
-			data_t ret = avlDeleteMin(&((*tree)->left));
+			data_t ret = avlDeleteMin(pool, &((*tree)->left));
 
 			(*tree)->size--;
 			updateHeight(*tree);
@@ -242,7 +374,7 @@ data_t avlDeleteMin(struct node **tree){
 			}
 
 			data_t ret = old->data;
-			free(old);
+			freeNode(pool, old);
 			old = NULL;
 
 			return ret;
@@ -251,10 +383,10 @@ data_t avlDeleteMin(struct node **tree){
 
 	return 0;
 }
-data_t avlDeleteMax(struct node **tree){
+data_t avlDeleteMax(struct avlPool *pool, struct node **tree){
 	if((*tree) != NULL){
 		if((*tree)->right != NULL){
-			data_t ret = avlDeleteMax(&((*tree)->right));
+			data_t ret = avlDeleteMax(pool, &((*tree)->right));
 			// Only update on successful remove
 			(*tree)->size--;
 			updateHeight(*tree);
@@ -274,7 +406,7 @@ data_t avlDeleteMax(struct node **tree){
 			}
 
 			data_t ret = old->data;
-			free(old);
+			freeNode(pool, old);
 			old = NULL;
 
 			return ret;
@@ -284,7 +416,7 @@ data_t avlDeleteMax(struct node **tree){
 	return -1;
 }
 
-int avlRemove(struct node **tree, data_t data){
+int avlPoolRemove(struct avlPool *pool, struct node **tree, data_t data){
 	if((*tree) != NULL){
 		int ret = 0;
 		if((*tree)->data == data){
@@ -292,22 +424,22 @@ int avlRemove(struct node **tree, data_t data){
 			// Maybe have it choose larger side to take from
 			if((*tree)->right != NULL){
 				// Get min value from right subtree to replace root
-				(*tree)->data = avlDeleteMin(&((*tree)->right));
+				(*tree)->data = avlDeleteMin(pool, &((*tree)->right));
 			}else if((*tree)->left != NULL){
 				// Get max value from left subtree to replace root
-				(*tree)->data = avlDeleteMax(&((*tree)->left));
+				(*tree)->data = avlDeleteMax(pool, &((*tree)->left));
 			}else{
 				// Node is leaf, simply delete
-				free(*tree);
+				freeNode(pool, *tree);
 				(*tree) = NULL;
 				return 0;
 			}
 
 			ret = 0;
 		}else if((*tree)->data > data){ // Traversal conditions
-			ret = avlRemove(&((*tree)->left), data);
+			ret = avlPoolRemove(pool, &((*tree)->left), data);
 		}else if((*tree)->data < data){
-			ret = avlRemove(&((*tree)->right), data);
+			ret = avlPoolRemove(pool, &((*tree)->right), data);
 		}
 
 		// Only update on successful remove
@@ -322,13 +454,301 @@ int avlRemove(struct node **tree, data_t data){
 
 	return -1;
 }
+#else
+/**	Walk back up a recorded path after a node was unlinked below it.
+	Sizes are fixed on every level, but height and rotation work stops as soon
+	as a subtree comes out with its old height, since nothing above can change.
+**/
+static void removeFixup(struct node **path[], int cnt){
+	size_t height;
+	int balance = 1;
+
+	while(--cnt >= 0){
+		(*path[cnt])->size--;
+		if(!balance) continue;
+
+		height = (*path[cnt])->height;
+		updateHeight(*path[cnt]);
+		rotate(path[cnt]);
+
+		if((*path[cnt])->height == height) balance = 0;
+	}
+}
+
+data_t avlDeleteMin(struct avlPool *pool, struct node **tree){
+	if((*tree) == NULL) return 0;
+
+	struct node **path[AVL_MAX_HEIGHT];
+	int cnt = 0;
+
+	while((*tree)->left != NULL && cnt < AVL_MAX_HEIGHT){
+		path[cnt++] = tree;
+		tree = &(*tree)->left;
+	}
+
+	// Min only has right child, move it up
+	struct node *old = (*tree);
+	(*tree) = old->right;
+	removeFixup(path, cnt);
+
+	data_t ret = old->data;
+	freeNode(pool, old);
+
+	return ret;
+}
+data_t avlDeleteMax(struct avlPool *pool, struct node **tree){
+	if((*tree) == NULL) return -1;
+
+	struct node **path[AVL_MAX_HEIGHT];
+	int cnt = 0;
+
+	while((*tree)->right != NULL && cnt < AVL_MAX_HEIGHT){
+		path[cnt++] = tree;
+		tree = &(*tree)->right;
+	}
+
+	// Max only has left child, move it up
+	struct node *old = (*tree);
+	(*tree) = old->left;
+	removeFixup(path, cnt);
+
+	data_t ret = old->data;
+	freeNode(pool, old);
+
+	return ret;
+}
+
+int avlPoolRemove(struct avlPool *pool, struct node **tree, data_t data){
+	if(tree == NULL) return -1;
+
+	struct node **path[AVL_MAX_HEIGHT];
+	int cnt = 0;
+
+	while(*tree != NULL && (*tree)->data != data && cnt < AVL_MAX_HEIGHT){
+		path[cnt++] = tree;
+		tree = ((*tree)->data > data) ? &(*tree)->left : &(*tree)->right;
+	}
+	if(*tree == NULL || (*tree)->data != data) return -1;
+
+	struct node *old = (*tree);
+	if(old->right != NULL){
+		// Replace data with min of right subtree, then unlink that instead
+		path[cnt++] = tree;
+		tree = &old->right;
+		while((*tree)->left != NULL && cnt < AVL_MAX_HEIGHT){
+			path[cnt++] = tree;
+			tree = &(*tree)->left;
+		}
+
+		old->data = (*tree)->data;
+		old = (*tree);
+		(*tree) = old->right;
+	}else{
+		// No right child means left is a single leaf (or NULL), move it up
+		(*tree) = old->left;
+	}
+
+	freeNode(pool, old);
+	removeFixup(path, cnt);
+
+	return 0;
+}
+#endif
+
+int avlRemove(struct node **tree, data_t data){
+	return avlPoolRemove(NULL, tree, data);
+}
+
+/**	Join/split machinery. Everything below works on whole subtrees, relinking
+	existing nodes instead of allocating, and fixes height and size on the way.
+**/
+static inline size_t heightOf(const struct node *tree){
+	return (tree != NULL) ? tree->height : 0;
+}
+
+static inline void updateNode(struct node *root){
+	updateHeight(root);
+	root->size = size(root->left) + size(root->right) + 1;
+}
+
+// Left is taller, so hang mid and right off its right spine
+static struct node *joinRight(struct node *left, struct node *mid, struct node *right){
+	if(heightOf(left->right) <= heightOf(right) + 1){
+		mid->left = left->right;
+		mid->right = right;
+		updateNode(mid);
+		left->right = mid;
+	}else{
+		left->right = joinRight(left->right, mid, right);
+	}
+
+	updateNode(left);
+	rotate(&left);
+
+	return left;
+}
+static struct node *joinLeft(struct node *left, struct node *mid, struct node *right){
+	if(heightOf(right->left) <= heightOf(left) + 1){
+		mid->left = left;
+		mid->right = right->left;
+		updateNode(mid);
+		right->left = mid;
+	}else{
+		right->left = joinLeft(left, mid, right->left);
+	}
+
+	updateNode(right);
+	rotate(&right);
+
+	return right;
+}
+
+/**	Join left, mid and right (in that order) into one tree, reusing mid node
+**/
+struct node *avlJoinMid(struct node *left, struct node *mid, struct node *right){
+	if(heightOf(left) > heightOf(right) + 1) return joinRight(left, mid, right);
+	if(heightOf(right) > heightOf(left) + 1) return joinLeft(left, mid, right);
+
+	mid->left = left;
+	mid->right = right;
+	updateNode(mid);
+
+	return mid;
+}
+
+/**	Detach max node of tree, leaving the rest in tree
+**/
+static struct node *splitLast(struct node **tree){
+	struct node *root = *tree;
+	if(root->right == NULL){
+		*tree = root->left;
+		return root;
+	}
+
+	struct node *right = root->right;
+	struct node *last = splitLast(&right);
+	*tree = avlJoinMid(root->left, root, right);
+
+	return last;
+}
+
+struct node *avlJoin(struct node *left, struct node *right){
+	if(left == NULL) return right;
+	if(right == NULL) return left;
+
+	struct node *mid = splitLast(&left);
+	return avlJoinMid(left, mid, right);
+}
+
+struct node *avlSplit(struct node *tree, data_t data, struct node **left, struct node **right){
+	if(tree == NULL){
+		*left = NULL;
+		*right = NULL;
+		return NULL;
+	}
+
+	struct node *found = NULL;
+	struct node *sub;
+	if(tree->data > data){
+		found = avlSplit(tree->left, data, left, &sub);
+		*right = avlJoinMid(sub, tree, tree->right);
+	}else if(tree->data < data){
+		found = avlSplit(tree->right, data, &sub, right);
+		*left = avlJoinMid(tree->left, tree, sub);
+	}else{
+		*left = tree->left;
+		*right = tree->right;
+
+		found = tree;
+		found->left = NULL;
+		found->right = NULL;
+		found->size = 1;
+		found->height = 1;
+	}
+
+	return found;
+}
+
+// Give every node of tree back to pool (or free)
+static void freeTree(struct avlPool *pool, struct node *tree){
+	if(tree == NULL) return;
+
+	freeTree(pool, tree->left);
+	freeTree(pool, tree->right);
+	freeNode(pool, tree);
+}
+
+/**	Set operations split a by root of b, recurse on both halves, then join.
+	Nodes of b are reused where possible, and nodes of duplicates are freed.
+**/
+struct node *avlPoolUnion(struct avlPool *pool, struct node *a, struct node *b){
+	if(a == NULL) return b;
+	if(b == NULL) return a;
+
+	struct node *left, *right;
+	struct node *dup = avlSplit(a, b->data, &left, &right);
+	if(dup != NULL) freeNode(pool, dup);
+
+	left = avlPoolUnion(pool, left, b->left);
+	right = avlPoolUnion(pool, right, b->right);
+
+	return avlJoinMid(left, b, right);
+}
+
+struct node *avlPoolIntersect(struct avlPool *pool, struct node *a, struct node *b){
+	if(a == NULL || b == NULL){
+		freeTree(pool, a);
+		freeTree(pool, b);
+		return NULL;
+	}
+
+	struct node *left, *right;
+	struct node *dup = avlSplit(a, b->data, &left, &right);
+
+	left = avlPoolIntersect(pool, left, b->left);
+	right = avlPoolIntersect(pool, right, b->right);
+
+	if(dup != NULL){
+		freeNode(pool, dup);
+		return avlJoinMid(left, b, right);
+	}
+
+	freeNode(pool, b);
+	return avlJoin(left, right);
+}
+
+struct node *avlPoolDifference(struct avlPool *pool, struct node *a, struct node *b){
+	if(a == NULL || b == NULL){
+		freeTree(pool, b);
+		return a;
+	}
+
+	struct node *left, *right;
+	struct node *dup = avlSplit(a, b->data, &left, &right);
+	if(dup != NULL) freeNode(pool, dup);
+
+	left = avlPoolDifference(pool, left, b->left);
+	right = avlPoolDifference(pool, right, b->right);
+	freeNode(pool, b);
+
+	return avlJoin(left, right);
+}
+
+struct node *avlUnion(struct node *a, struct node *b){
+	return avlPoolUnion(NULL, a, b);
+}
+struct node *avlIntersect(struct node *a, struct node *b){
+	return avlPoolIntersect(NULL, a, b);
+}
+struct node *avlDifference(struct node *a, struct node *b){
+	return avlPoolDifference(NULL, a, b);
+}
 
 // Returns non-zero if data is in tree, zero otherwise
 int avlFind(struct node *tree, data_t data, data_t **value){
-	printf("%p\n", value);
 	if(tree != NULL){
 		if(tree->data == data){
-			*value = &tree->data;
+			if(value != NULL) *value = &tree->data;
 			return 1; // Found data
 		}
 		else if(tree->data > data) return avlFind(tree->left, data, value); // Recurse to add
@@ -338,16 +758,101 @@ int avlFind(struct node *tree, data_t data, data_t **value){
 	return 0;// Not found (false)
 }
 
+/**	Keeps AVL_BATCH_WIDTH searches in flight, moving each one level per round
+	and prefetching the child it lands on. By the time a search comes around
+	again its node should be in cache, so misses overlap across keys.
+	Finished searches are refilled with the next key right away.
+**/
+void avlFindBatch(const struct node *tree, const data_t *keys, size_t n, int *results){
+	const struct node *cur[AVL_BATCH_WIDTH];
+	size_t idx[AVL_BATCH_WIDTH];
+	size_t next = 0;
+	int active = 0;
+
+	for(int i = 0;i < AVL_BATCH_WIDTH;i++){
+		if(next < n){
+			cur[i] = tree;
+			idx[i] = next++;
+			active++;
+		}else{
+			idx[i] = n; // Lane unused
+		}
+	}
+
+	const struct node *node;
+	data_t key;
+	while(active > 0){
+		for(int i = 0;i < AVL_BATCH_WIDTH;i++){
+			if(idx[i] == n) continue;
+
+			node = cur[i];
+			key = keys[idx[i]];
+			if(node == NULL || node->data == key){
+				results[idx[i]] = (node != NULL);
+
+				if(next < n){
+					cur[i] = tree;
+					idx[i] = next++;
+				}else{
+					idx[i] = n;
+					active--;
+				}
+				continue;
+			}
+
+			node = (node->data > key) ? node->left : node->right;
+			PREFETCH(node);
+			cur[i] = node;
+		}
+	}
+}
+
+// Size is kept in every node, so no need to count
 size_t size(const struct node *tree){
-	if(tree != NULL){
-		size_t count = size(tree->left);
-		count++; // This node
-		count += size(tree->right);
+	return (tree != NULL) ? tree->size : 0;
+}
 
-		return count;
+/**	Walk down using subtree sizes, skipping left subtrees smaller than k
+**/
+int avlSelect(const struct node *tree, size_t k, data_t *val){
+	size_t left;
+	while(tree != NULL){
+		left = size(tree->left);
+
+		if(k < left){
+			tree = tree->left;
+		}else if(k > left){
+			k -= left + 1; // Skip left subtree and this node
+			tree = tree->right;
+		}else{
+			if(val != NULL) *val = tree->data;
+			return 1;
+		}
 	}
 
-	return 0;
+	return 0; // k out of range
+}
+
+size_t avlRank(const struct node *tree, data_t data){
+	size_t rank = 0;
+	while(tree != NULL){
+		if(tree->data < data){
+			rank += size(tree->left) + 1; // Left subtree and this node are smaller
+			tree = tree->right;
+		}else if(tree->data > data){
+			tree = tree->left;
+		}else{
+			return rank + size(tree->left);
+		}
+	}
+
+	return rank;
+}
+
+size_t avlCountRange(const struct node *tree, data_t lo, data_t hi){
+	if(lo >= hi) return 0;
+
+	return avlRank(tree, hi) - avlRank(tree, lo);
 }
 
 size_t maxHeight(const struct node *root){
@@ -382,6 +887,107 @@ data_t min(const struct node *tree){
 	return min(tree->left);
 }
 
+/**	Push node and its left (or right) spine onto cursor stack
+**/
+static inline void iterPushLeft(struct avlIter *it, const struct node *tree){
+	while(tree != NULL && it->depth < AVL_MAX_HEIGHT){
+		it->stack[it->depth++] = tree;
+		tree = tree->left;
+	}
+}
+static inline void iterPushRight(struct avlIter *it, const struct node *tree){
+	while(tree != NULL && it->depth < AVL_MAX_HEIGHT){
+		it->stack[it->depth++] = tree;
+		tree = tree->right;
+	}
+}
+
+/**	Move cursor to in-order successor. Without a right subtree, climb until
+	coming up from a left child, as that parent is next.
+**/
+static inline void iterForward(struct avlIter *it){
+	const struct node *child = it->stack[it->depth-1];
+	if(child->right != NULL){
+		iterPushLeft(it, child->right);
+		return;
+	}
+
+	do{
+		child = it->stack[--it->depth];
+	}while(it->depth > 0 && it->stack[it->depth-1]->right == child);
+}
+static inline void iterBackward(struct avlIter *it){
+	const struct node *child = it->stack[it->depth-1];
+	if(child->left != NULL){
+		iterPushRight(it, child->left);
+		return;
+	}
+
+	do{
+		child = it->stack[--it->depth];
+	}while(it->depth > 0 && it->stack[it->depth-1]->left == child);
+}
+
+void avlIterBegin(struct avlIter *it, const struct node *tree){
+	it->depth = 0;
+	iterPushLeft(it, tree);
+}
+
+void avlIterSeek(struct avlIter *it, const struct node *tree, data_t data){
+	int found = 0; // Depth of lowest node >= data seen so far
+
+	it->depth = 0;
+	while(tree != NULL && it->depth < AVL_MAX_HEIGHT){
+		it->stack[it->depth++] = tree;
+
+		if(tree->data > data){
+			found = it->depth;
+			tree = tree->left;
+		}else if(tree->data < data){
+			tree = tree->right;
+		}else{
+			found = it->depth;
+			break;
+		}
+	}
+
+	// Path to that node is a prefix of the search path
+	it->depth = found;
+}
+
+int avlIterNext(struct avlIter *it, data_t *val){
+	if(it->depth <= 0) return 0;
+
+	if(val != NULL) *val = it->stack[it->depth-1]->data;
+	iterForward(it);
+
+	return 1;
+}
+
+int avlIterPrev(struct avlIter *it, data_t *val){
+	if(it->depth <= 0) return 0;
+
+	if(val != NULL) *val = it->stack[it->depth-1]->data;
+	iterBackward(it);
+
+	return 1;
+}
+
+size_t avlIterRange(struct avlIter *it, data_t hi, data_t *out, size_t max){
+	size_t cnt = 0;
+	const struct node *cur;
+
+	while(cnt < max && it->depth > 0){
+		cur = it->stack[it->depth-1];
+		if(cur->data >= hi) break;
+
+		out[cnt++] = cur->data;
+		iterForward(it);
+	}
+
+	return cnt;
+}
+
 void printTree(struct node *tree){
 	if(tree != NULL){
 		printTree(tree->left);
@@ -400,3 +1006,24 @@ void destroy(struct node **tree){
 		*tree = NULL;
 	}
 }
+
+/**	Pool owns every node of the tree, so just release the blocks
+**/
+void avlPoolDestroy(struct avlPool *pool, struct node **tree){
+	if(pool == NULL){
+		if(tree != NULL) destroy(tree);
+		return;
+	}
+
+	struct node *next;
+	while(pool->blocks != NULL){
+		next = pool->blocks->left;
+		free(pool->blocks);
+		pool->blocks = next;
+	}
+
+	pool->free = NULL;
+	pool->used = 0;
+	pool->avail = 0;
+	if(tree != NULL) *tree = NULL;
+}
@@ -33,28 +33,120 @@ typedef struct node{
 	struct node *right;
 } Node;
 
+#define AVL_MAX_HEIGHT 64		// Path stack depth for iterative variants
+
+#define AVL_BATCH_WIDTH 16		// Searches in flight for batched find
+
+#define AVL_POOL_ALIGN 64		// Blocks are aligned to cache line
+#define AVL_POOL_BLOCK 4096		// Default nodes per block
+
+/**	Node pool that hands out nodes from large aligned blocks instead of malloc.
+	Released nodes are kept on an intrusive free list (linked through left).
+	A pool belongs to a single tree, so the tree can be freed a block at a time.
+**/
+struct avlPool{
+	struct node *blocks;	// Block list, linked through first node of each block
+	struct node *free;		// Free list of released nodes
+	size_t used;			// Nodes handed out from head block
+	size_t avail;			// Total nodes in head block
+	size_t blockSize;		// Nodes per new block
+};
+
 // Return  0 if inserted, non-zero otherwise
 int avlInsert(struct node **, data_t data);
 
+// Return new tree built in O(n) from strictly increasing keys, NULL on failure
+struct node *avlBuildSorted(const data_t *keys, size_t n);
+
 // Return 0 if removed, non-zero otherwise
 int avlRemove(struct node **, data_t data);
 
 // Return non-zero if found, 0 otherwise
 int avlFind(struct node *, data_t data, data_t **val);
 
+// Look up n keys at once, setting results[i] non-zero if keys[i] was found
+void avlFindBatch(const struct node *, const data_t *keys, size_t n, int *results);
+
 // Return max/min number
 data_t max(const struct node *);
 data_t min(const struct node *);
 
-// Get total number of items in tree
+// Get total number of items in tree (constant time)
 size_t size(const struct node *);
 
+// Return non-zero and set val to k-th smallest (from 0), 0 if out of range
+int avlSelect(const struct node *, size_t k, data_t *val);
+
+// Return number of items smaller than data
+size_t avlRank(const struct node *, data_t data);
+
+// Return number of items in [lo, hi)
+size_t avlCountRange(const struct node *, data_t lo, data_t hi);
+
 size_t maxHeight(const struct node *);
 
+/**	Join based set operations. Input trees are consumed and their nodes
+	relinked into the result, so inputs must not be used afterwards.
+**/
+// Join trees where all items of left are smaller than all items of right
+struct node *avlJoin(struct node *left, struct node *right);
+
+// Same, with a single detached node going between left and right
+struct node *avlJoinMid(struct node *left, struct node *mid, struct node *right);
+
+// Split tree into items < data and > data. Returns detached node holding data, or NULL
+struct node *avlSplit(struct node *, data_t data, struct node **left, struct node **right);
+
+// Items in either/both trees, and items of a not in b
+struct node *avlUnion(struct node *a, struct node *b);
+struct node *avlIntersect(struct node *a, struct node *b);
+struct node *avlDifference(struct node *a, struct node *b);
+
 // Prints whole tree (in-order)
 void printTree(struct node *);
 
 // Free up entire tree
 void destroy(struct node **);
 
+/**	In-order cursor. Keeps the path from root to current node on a fixed stack,
+	so stepping needs no allocation or recursion. Tree must not change while
+	a cursor is in use.
+**/
+struct avlIter{
+	const struct node *stack[AVL_MAX_HEIGHT];
+	int depth;				// 0 when cursor has run off either end
+};
+
+// Place cursor on smallest item
+void avlIterBegin(struct avlIter *, const struct node *);
+
+// Place cursor on smallest item >= data
+void avlIterSeek(struct avlIter *, const struct node *, data_t data);
+
+// Return non-zero and set val to current item, then step forward/backward
+int avlIterNext(struct avlIter *, data_t *val);
+int avlIterPrev(struct avlIter *, data_t *val);
+
+// Copy up to max items < hi into out, continuing from cursor. Return count
+size_t avlIterRange(struct avlIter *, data_t hi, data_t *out, size_t max);
+
+/**	Pool variants. A NULL pool falls back to malloc/free per node.
+**/
+// Return 0 if initialized, non-zero otherwise. Block size 0 uses default
+int avlPoolInit(struct avlPool *, size_t blockSize);
+
+int avlPoolInsert(struct avlPool *, struct node **, data_t data);
+int avlPoolRemove(struct avlPool *, struct node **, data_t data);
+
+// Build tree with all nodes in one contiguous block
+struct node *avlPoolBuildSorted(struct avlPool *, const data_t *keys, size_t n);
+
+// Set operations on trees from the same pool, freed nodes go back to it
+struct node *avlPoolUnion(struct avlPool *, struct node *a, struct node *b);
+struct node *avlPoolIntersect(struct avlPool *, struct node *a, struct node *b);
+struct node *avlPoolDifference(struct avlPool *, struct node *a, struct node *b);
+
+// Free entire tree by releasing every block in the pool
+void avlPoolDestroy(struct avlPool *, struct node **);
+
 #endif
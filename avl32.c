@@ -0,0 +1,371 @@
+/*
+	avl32.c -- Compact AVL tree with index-addressed nodes
+
+	Copyright (C) 2020 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#include"avl32.h"
+
+#define AVL32_DEFAULT_CAP 1024
+
+/**	Field helpers. Balance is height(right) - height(left), stored in 2 bits
+	as 0 (even), 1 (left heavy) or 2 (right heavy).
+**/
+static inline uint32_t getLeft(const struct avl32 *t, uint32_t i){
+	return t->nodes[i].left & AVL32_IDX_MASK;
+}
+static inline void setLeft(struct avl32 *t, uint32_t i, uint32_t child){
+	t->nodes[i].left = (t->nodes[i].left & ~AVL32_IDX_MASK) | child;
+}
+static inline int getBal(const struct avl32 *t, uint32_t i){
+	uint32_t bits = t->nodes[i].left >> 30;
+	return (bits == 1) ? -1 : (bits == 2) ? 1 : 0;
+}
+static inline void setBal(struct avl32 *t, uint32_t i, int bal){
+	uint32_t bits = (bal < 0) ? 1 : (bal > 0) ? 2 : 0;
+	t->nodes[i].left = (t->nodes[i].left & AVL32_IDX_MASK) | (bits << 30);
+}
+
+#ifdef AVL32_SIZE
+static inline uint32_t getSize(const struct avl32 *t, uint32_t i){
+	return (i) ? t->nodes[i].size : 0;
+}
+static inline void updateSize(struct avl32 *t, uint32_t i){
+	t->nodes[i].size = getSize(t, getLeft(t, i)) + getSize(t, t->nodes[i].right) + 1;
+}
+#endif
+
+/**	Make sure one node can be handed out without moving the array.
+	Called before descending, so node pointers stay valid during insert.
+**/
+static int reserve(struct avl32 *t){
+	if(t->free || t->used < t->cap) return 0;
+	if(t->cap >= AVL32_MAX_NODES) return -1;
+
+	size_t cap = (size_t)t->cap * 2;
+	if(cap > AVL32_MAX_NODES) cap = AVL32_MAX_NODES;
+
+	void *tmp = realloc(t->nodes, cap * sizeof(*t->nodes));
+	if(tmp == NULL) return -1;
+
+	t->nodes = tmp;
+	t->cap = cap;
+
+	return 0;
+}
+
+static uint32_t newNode(struct avl32 *t, data_t data){
+	uint32_t i;
+	if(t->free){
+		i = t->free;
+		t->free = t->nodes[i].left;
+	}else{
+		i = t->used++;
+	}
+
+	t->nodes[i].data = data;
+	t->nodes[i].left = 0;
+	t->nodes[i].right = 0;
+#ifdef AVL32_SIZE
+	t->nodes[i].size = 1;
+#endif
+
+	return i;
+}
+
+static inline void freeNode(struct avl32 *t, uint32_t i){
+	t->nodes[i].left = t->free;
+	t->free = i;
+}
+
+/**	Rotations return the new subtree root. Balance updates hold for any
+	starting balance, including the +-2 that is never stored.
+**/
+static uint32_t rotateLeft(struct avl32 *t, uint32_t x, int *balX, int *balY){
+	uint32_t y = t->nodes[x].right;
+
+	t->nodes[x].right = getLeft(t, y);
+	setLeft(t, y, x);
+
+	*balX = *balX - 1 - ((*balY > 0) ? *balY : 0);
+	*balY = *balY - 1 + ((*balX < 0) ? *balX : 0);
+
+#ifdef AVL32_SIZE
+	t->nodes[y].size = t->nodes[x].size;
+	updateSize(t, x);
+#endif
+
+	return y;
+}
+static uint32_t rotateRight(struct avl32 *t, uint32_t x, int *balX, int *balY){
+	uint32_t y = getLeft(t, x);
+
+	setLeft(t, x, t->nodes[y].right);
+	t->nodes[y].right = x;
+
+	*balX = *balX + 1 - ((*balY < 0) ? *balY : 0);
+	*balY = *balY + 1 + ((*balX > 0) ? *balX : 0);
+
+#ifdef AVL32_SIZE
+	t->nodes[y].size = t->nodes[x].size;
+	updateSize(t, x);
+#endif
+
+	return y;
+}
+
+/**	Fix node x with (unstored) balance of +-2, returning the new subtree root.
+	Sets shrank when the subtree is now one shorter than before the imbalance.
+**/
+static uint32_t rebalance(struct avl32 *t, uint32_t x, int bal, int *shrank){
+	uint32_t y, z;
+	int balY, balZ;
+
+	if(bal > 0){
+		y = t->nodes[x].right;
+		balY = getBal(t, y);
+		*shrank = (balY != 0);
+
+		if(balY < 0){
+			// Right-left, rotate right child first
+			z = getLeft(t, y);
+			balZ = getBal(t, z);
+			t->nodes[x].right = rotateRight(t, y, &balY, &balZ);
+			setBal(t, y, balY);
+			balY = balZ;
+			y = z;
+		}
+
+		y = rotateLeft(t, x, &bal, &balY);
+	}else{
+		y = getLeft(t, x);
+		balY = getBal(t, y);
+		*shrank = (balY != 0);
+
+		if(balY > 0){
+			// Left-right, rotate left child first
+			z = y;
+			y = t->nodes[z].right;
+			balZ = getBal(t, y);
+			setLeft(t, x, rotateLeft(t, z, &balY, &balZ));
+			setBal(t, z, balY);
+			balY = balZ;
+		}
+
+		y = rotateRight(t, x, &bal, &balY);
+	}
+
+	setBal(t, x, bal);
+	setBal(t, y, balY);
+
+	return y;
+}
+
+/**	Recursive insert, returning new subtree root.
+	res is -1 for duplicate, 0 if inserted, 1 if inserted and subtree grew
+**/
+static uint32_t insert(struct avl32 *t, uint32_t i, data_t data, int *res){
+	if(i == 0){
+		*res = 1;
+		return newNode(t, data);
+	}
+
+	int bal = getBal(t, i);
+	if(t->nodes[i].data > data){
+		setLeft(t, i, insert(t, getLeft(t, i), data, res));
+		bal -= (*res > 0);
+	}else if(t->nodes[i].data < data){
+		t->nodes[i].right = insert(t, t->nodes[i].right, data, res);
+		bal += (*res > 0);
+	}else{
+		*res = -1;
+		return i;
+	}
+
+	if(*res < 0) return i;
+#ifdef AVL32_SIZE
+	t->nodes[i].size++;
+#endif
+	if(*res == 0) return i;
+
+	// Child grew
+	if(bal == 0){
+		*res = 0;
+	}else if(bal == 1 || bal == -1){
+		*res = 1;
+	}else{
+		int shrank;
+		i = rebalance(t, i, bal, &shrank);
+		*res = 0; // Rotation restores old height on insert
+		return i;
+	}
+
+	setBal(t, i, bal);
+	return i;
+}
+
+/**	One side of node i got shorter, leaving balance bal. Sets res to 1 if
+	subtree i is now shorter too, and returns new subtree root.
+**/
+static uint32_t shortened(struct avl32 *t, uint32_t i, int bal, int *res){
+	if(bal == 0){
+		*res = 1;
+	}else if(bal == 1 || bal == -1){
+		*res = 0;
+	}else{
+		return rebalance(t, i, bal, res);
+	}
+
+	setBal(t, i, bal);
+	return i;
+}
+
+/**	Unlink min of subtree i, storing its data in min
+**/
+static uint32_t removeMin(struct avl32 *t, uint32_t i, data_t *min, int *res){
+	uint32_t left = getLeft(t, i);
+	if(left == 0){
+		uint32_t right = t->nodes[i].right;
+		*min = t->nodes[i].data;
+		freeNode(t, i);
+		*res = 1;
+		return right;
+	}
+
+	setLeft(t, i, removeMin(t, left, min, res));
+#ifdef AVL32_SIZE
+	t->nodes[i].size--;
+#endif
+	if(*res == 0) return i;
+
+	return shortened(t, i, getBal(t, i) + 1, res);
+}
+
+/**	Recursive remove, returning new subtree root.
+	res is -1 if not found, 0 if removed, 1 if removed and subtree shrank
+**/
+static uint32_t removeData(struct avl32 *t, uint32_t i, data_t data, int *res){
+	if(i == 0){
+		*res = -1;
+		return 0;
+	}
+
+	int bal = getBal(t, i);
+	if(t->nodes[i].data > data){
+		setLeft(t, i, removeData(t, getLeft(t, i), data, res));
+		bal++;
+	}else if(t->nodes[i].data < data){
+		t->nodes[i].right = removeData(t, t->nodes[i].right, data, res);
+		bal--;
+	}else{
+		uint32_t left = getLeft(t, i);
+		uint32_t right = t->nodes[i].right;
+		if(left == 0 || right == 0){
+			// At most one child, move it up
+			freeNode(t, i);
+			*res = 1;
+			return (left) ? left : right;
+		}
+
+		// Replace data with min of right subtree
+		t->nodes[i].right = removeMin(t, right, &t->nodes[i].data, res);
+		bal--;
+	}
+
+	if(*res < 0) return i;
+#ifdef AVL32_SIZE
+	t->nodes[i].size--;
+#endif
+	if(*res == 0) return i;
+
+	return shortened(t, i, bal, res);
+}
+
+int avl32Init(struct avl32 *t, size_t cap){
+	if(t == NULL) return -1;
+	if(cap == 0) cap = AVL32_DEFAULT_CAP;
+	if(cap > AVL32_MAX_NODES) cap = AVL32_MAX_NODES;
+
+	t->nodes = malloc((cap + 1) * sizeof(*t->nodes));
+	if(t->nodes == NULL) return -1;
+
+	t->root = 0;
+	t->free = 0;
+	t->used = 1; // Index 0 is NULL
+	t->cap = cap + 1;
+	t->size = 0;
+
+	return 0;
+}
+
+int avl32Insert(struct avl32 *t, data_t data){
+	if(t == NULL || reserve(t)) return -1;
+
+	int res;
+	t->root = insert(t, t->root, data, &res);
+	if(res < 0) return -1;
+
+	t->size++;
+	return 0;
+}
+
+int avl32Remove(struct avl32 *t, data_t data){
+	if(t == NULL) return -1;
+
+	int res;
+	t->root = removeData(t, t->root, data, &res);
+	if(res < 0) return -1;
+
+	t->size--;
+	return 0;
+}
+
+int avl32Find(struct avl32 *t, data_t data, data_t **val){
+	if(t == NULL) return 0;
+
+	uint32_t i = t->root;
+	while(i){
+		if(t->nodes[i].data > data){
+			i = getLeft(t, i);
+		}else if(t->nodes[i].data < data){
+			i = t->nodes[i].right;
+		}else{
+			if(val != NULL) *val = &t->nodes[i].data;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+size_t avl32Size(const struct avl32 *t){
+	return (t != NULL) ? t->size : 0;
+}
+
+size_t avl32Bytes(const struct avl32 *t){
+	return (t != NULL) ? (size_t)t->cap * sizeof(*t->nodes) : 0;
+}
+
+void avl32Destroy(struct avl32 *t){
+	if(t == NULL) return;
+
+	free(t->nodes);
+	t->nodes = NULL;
+	t->root = 0;
+	t->free = 0;
+	t->used = 0;
+	t->cap = 0;
+	t->size = 0;
+}
@@ -0,0 +1,74 @@
+/*
+	avl32.h -- Compact AVL tree with index-addressed nodes
+
+	Copyright (C) 2020 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#ifndef AVL32_H_
+#define AVL32_H_
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include"avl.h"
+
+#define AVL32_IDX_MASK 0x3FFFFFFF	// Low 30 bits of left hold child index
+#define AVL32_MAX_NODES AVL32_IDX_MASK
+
+/**	16 byte node. Children are indices into the tree's node array (0 is NULL),
+	and the top 2 bits of left hold the balance factor.
+	Define AVL32_SIZE to also keep a 32-bit subtree size (24 byte node).
+**/
+struct avl32Node{
+	data_t data;
+	uint32_t left;			// Index | balance << 30
+	uint32_t right;
+#ifdef AVL32_SIZE
+	uint32_t size;			// Size of subtree, including this node
+#endif
+};
+
+// Tree handle, owns the node array
+struct avl32{
+	struct avl32Node *nodes;	// Index 0 is never used
+	uint32_t root;
+	uint32_t free;			// Free list of released nodes, linked through left
+	uint32_t used;			// Nodes handed out from array (including index 0)
+	uint32_t cap;			// Nodes in array
+	size_t size;			// Total items in tree
+};
+
+// Return 0 if initialized, non-zero otherwise. Capacity 0 uses default
+int avl32Init(struct avl32 *, size_t cap);
+
+// Return  0 if inserted, non-zero otherwise
+int avl32Insert(struct avl32 *, data_t data);
+
+// Return 0 if removed, non-zero otherwise
+int avl32Remove(struct avl32 *, data_t data);
+
+// Return non-zero if found, 0 otherwise. Value pointer is valid until next insert
+int avl32Find(struct avl32 *, data_t data, data_t **val);
+
+// Get total number of items in tree
+size_t avl32Size(const struct avl32 *);
+
+// Bytes held by the node array
+size_t avl32Bytes(const struct avl32 *);
+
+// Free up entire tree
+void avl32Destroy(struct avl32 *);
+
+#endif
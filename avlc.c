@@ -0,0 +1,498 @@
+/*
+	avlc.c -- Concurrent AVL tree with optimistic readers
+
+	Copyright (C) 2020 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#include<sched.h>
+#include"avlc.h"
+
+#define SHRINKING 1
+#define UNLINKED 2
+#define VERSION_STEP 4
+
+#define RETRY -2
+
+#define LEFT 0
+#define RIGHT 1
+
+// Writer tries to free retired nodes once this many are waiting
+#define RETIRE_BATCH 64
+
+// What a node needs, when it isn't just a new height
+#define NOTHING_REQUIRED -1
+#define REBALANCE_REQUIRED -2
+#define UNLINK_REQUIRED -3
+
+/**	Epoch based reclamation. Readers and writers announce the epoch they
+	started in, and the epoch only advances once every active thread has
+	seen it. Nodes retired two epochs back can't be reached by anyone.
+**/
+static inline void epochEnter(struct avlc *t, int tid){
+	uint64_t e = atomic_load(&t->epoch);
+	atomic_store(&t->slots[tid].epoch, (e << 1) | 1);
+}
+static inline void epochExit(struct avlc *t, int tid){
+	atomic_store_explicit(&t->slots[tid].epoch, 0, memory_order_release);
+}
+
+static void freeList(struct avlcNode *list){
+	struct avlcNode *next;
+	while(list != NULL){
+		next = list->next;
+		free(list);
+		list = next;
+	}
+}
+
+// Caller holds retireLock
+static void tryAdvance(struct avlc *t){
+	uint64_t e = atomic_load(&t->epoch);
+	uint64_t active = (e << 1) | 1;
+	uint64_t slot;
+
+	for(int i = 0;i < t->threads;i++){
+		slot = atomic_load(&t->slots[i].epoch);
+		if(slot != 0 && slot != active) return; // Someone still in older epoch
+	}
+
+	atomic_store(&t->epoch, e + 1);
+
+	// Nodes retired in e-1 were unlinked before anyone now active started
+	freeList(t->retired[(e + 2) % 3]);
+	t->retired[(e + 2) % 3] = NULL;
+	t->pending = 0;
+	for(int i = 0;i < 3;i++){
+		for(struct avlcNode *n = t->retired[i];n != NULL;n = n->next) t->pending++;
+	}
+}
+
+static void retire(struct avlc *t, struct avlcNode *old){
+	pthread_mutex_lock(&t->retireLock);
+
+	uint64_t e = atomic_load(&t->epoch);
+	old->next = t->retired[e % 3];
+	t->retired[e % 3] = old;
+
+	if(++t->pending >= RETIRE_BATCH) tryAdvance(t);
+
+	pthread_mutex_unlock(&t->retireLock);
+}
+
+/**	Reader. Loads only need acquire, as each link is read before the version
+	that validates it (same as a seqlock reader). Caller has checked that node still had version nodeV when it
+	picked dir, so node's subtree holds data if anything does. Child is only
+	followed once node's version is seen unchanged after reading the link.
+	Returns RETRY if node changed, so the caller re-reads its own link.
+**/
+static int attemptFind(struct avlcNode *node, int dir, uint64_t nodeV, data_t data){
+	struct avlcNode *child;
+	uint64_t childV;
+	int res;
+
+	while(1){
+		child = atomic_load_explicit(&node->child[dir], memory_order_acquire);
+		if(atomic_load_explicit(&node->version, memory_order_acquire) != nodeV) return RETRY;
+
+		if(child == NULL) return 0;
+		if(child->data == data) return atomic_load_explicit(&child->present, memory_order_acquire);
+
+		childV = atomic_load_explicit(&child->version, memory_order_acquire);
+		if(childV & SHRINKING){
+			// Rotation in progress, wait for it before going down
+			while(atomic_load_explicit(&child->version, memory_order_acquire) == childV) sched_yield();
+			continue;
+		}
+		if(childV & UNLINKED) continue;
+		if(atomic_load_explicit(&node->child[dir], memory_order_acquire) != child) continue;
+		if(atomic_load_explicit(&node->version, memory_order_acquire) != nodeV) return RETRY;
+
+		res = attemptFind(child, (child->data > data) ? LEFT : RIGHT, childV, data);
+		if(res != RETRY) return res;
+	}
+}
+
+int avlcFind(struct avlc *t, int tid, data_t data){
+	if(t == NULL || tid < 0 || tid >= t->threads) return 0;
+
+	epochEnter(t, tid);
+
+	// Holder never changes version, so this never returns RETRY
+	int res = attemptFind(&t->holder, RIGHT, 0, data);
+
+	epochExit(t, tid);
+
+	return res;
+}
+
+/**	Writer side. Writers find their spot the same way readers do, then lock
+	only the nodes they change. Locks are always taken top down: a parent,
+	then its child once it is checked to still be that parent's child, then
+	that child's children. Child links and versions only change under the
+	node's own lock, and parent links under the old parent's lock.
+	Heights are read without locks, so balance is only restored as each
+	writer walks back up, same as Bronson et al.
+**/
+static inline void lockNode(struct avlcNode *n){
+	while(atomic_exchange_explicit(&n->lock, 1, memory_order_acquire)){
+		// Held for a handful of stores, unless the holder isn't running
+		while(atomic_load_explicit(&n->lock, memory_order_relaxed)) sched_yield();
+	}
+}
+static inline void unlockNode(struct avlcNode *n){
+	atomic_store_explicit(&n->lock, 0, memory_order_release);
+}
+
+static inline struct avlcNode *getChild(struct avlcNode *n, int dir){
+	return atomic_load_explicit(&n->child[dir], memory_order_acquire);
+}
+
+static inline int heightOf(struct avlcNode *n){
+	return (n != NULL) ? atomic_load_explicit(&n->height, memory_order_relaxed) : 0;
+}
+
+// Caller holds n
+static inline void updateHeight(struct avlcNode *n){
+	int left = heightOf(getChild(n, LEFT));
+	int right = heightOf(getChild(n, RIGHT));
+
+	atomic_store_explicit(&n->height, ((left > right) ? left : right) + 1, memory_order_relaxed);
+}
+
+/**	Unlink if n is a routing node with less than two children, rebalance if
+	its children differ in height by more than one, otherwise its new height
+	(NOTHING_REQUIRED if unchanged). Stable only if n is locked.
+**/
+static int nodeCondition(struct avlcNode *n){
+	struct avlcNode *left = getChild(n, LEFT);
+	struct avlcNode *right = getChild(n, RIGHT);
+	if((left == NULL || right == NULL) && !atomic_load(&n->present)) return UNLINK_REQUIRED;
+
+	int hl = heightOf(left);
+	int hr = heightOf(right);
+	if(hl - hr > 1 || hr - hl > 1) return REBALANCE_REQUIRED;
+
+	int h = ((hl > hr) ? hl : hr) + 1;
+	return (h != heightOf(n)) ? h : NOTHING_REQUIRED;
+}
+
+/**	Rotate child n of parent so that its child on side dir takes its place.
+	n is flagged shrinking while keys on that side move out of its subtree.
+	Caller holds parent, n and that child.
+**/
+static void rotate(struct avlcNode *parent, int pdir, int dir){
+	struct avlcNode *n = getChild(parent, pdir);
+	struct avlcNode *c = getChild(n, dir);
+	struct avlcNode *inner = getChild(c, !dir);
+	uint64_t v = atomic_load_explicit(&n->version, memory_order_relaxed);
+
+	atomic_store(&n->version, v | SHRINKING);
+
+	atomic_store(&n->child[dir], inner);
+	if(inner != NULL) atomic_store(&inner->parent, n);
+	atomic_store(&c->child[!dir], n);
+	atomic_store(&n->parent, c);
+	atomic_store(&parent->child[pdir], c);
+	atomic_store(&c->parent, parent);
+
+	atomic_store(&n->version, v + VERSION_STEP);
+
+	updateHeight(n);
+	updateHeight(c);
+}
+
+/**	Remove n, which has at most one child, from parent. Caller holds both
+**/
+static void unlink(struct avlc *t, struct avlcNode *parent, int pdir){
+	struct avlcNode *n = getChild(parent, pdir);
+	struct avlcNode *c = getChild(n, LEFT);
+	if(c == NULL) c = getChild(n, RIGHT);
+
+	uint64_t v = atomic_load_explicit(&n->version, memory_order_relaxed);
+	atomic_store(&n->version, (v + VERSION_STEP) | UNLINKED);
+	atomic_store(&parent->child[pdir], c);
+	if(c != NULL) atomic_store(&c->parent, parent);
+
+	retire(t, n);
+}
+
+/**	Fix n, with n and its parent held. A rotation also locks the taller
+	child, and for the inner case that child's inner child. Nodes a rotation
+	moved down that need more work go in below, for after the locks are let
+	go. Returns the node to look at next, NULL if done.
+**/
+static struct avlcNode *rebalance(struct avlc *t, struct avlcNode *parent, struct avlcNode *n, struct avlcNode *below[2]){
+	int pdir = (getChild(parent, LEFT) == n) ? LEFT : RIGHT;
+	int cond = nodeCondition(n);
+	if(cond == UNLINK_REQUIRED){
+		unlink(t, parent, pdir);
+		return parent;
+	}
+	if(cond == NOTHING_REQUIRED) return NULL;
+	if(cond != REBALANCE_REQUIRED){
+		atomic_store_explicit(&n->height, cond, memory_order_relaxed);
+		return parent;
+	}
+
+	int dir = (heightOf(getChild(n, LEFT)) > heightOf(getChild(n, RIGHT))) ? LEFT : RIGHT; // Taller side
+	struct avlcNode *c = getChild(n, dir);
+	lockNode(c);
+
+	struct avlcNode *g = getChild(c, !dir);
+	int twice = (heightOf(g) > heightOf(getChild(c, dir)));
+	if(twice){
+		lockNode(g);
+		rotate(n, dir, !dir);
+		rotate(parent, pdir, dir);
+		unlockNode(g);
+	}else{
+		rotate(parent, pdir, dir);
+	}
+	unlockNode(c);
+
+	// Other writers may have changed what is below, or they may be routing
+	// nodes left with one child. Parent is still owed a look either way
+	if(nodeCondition(n) != NOTHING_REQUIRED) below[0] = n;
+	if(twice && nodeCondition(c) != NOTHING_REQUIRED) below[1] = c;
+	return parent;
+}
+
+/**	Walk up from n fixing heights, rotating, and unlinking routing nodes
+	that no longer route anything, until a node needs nothing. That is only
+	decided with the node locked: a rotation that read a child's old height
+	holds the lock until its own height is stored, so the writer that
+	changed the child either waits for it or is seen by it.
+**/
+static void fixPath(struct avlc *t, struct avlcNode *n){
+	struct avlcNode *parent, *next, *below[2];
+	int cond;
+
+	while(n != NULL && n != &t->holder){
+		if(atomic_load(&n->version) & UNLINKED) return; // Unlinker carries on from its parent
+
+		// Unlocked look, only to see how much to lock
+		cond = nodeCondition(n);
+		if(cond != UNLINK_REQUIRED && cond != REBALANCE_REQUIRED){
+			lockNode(n);
+			cond = nodeCondition(n);
+			next = n; // Needs its parent after all, go round again
+			if(cond == NOTHING_REQUIRED || (atomic_load(&n->version) & UNLINKED)){
+				next = NULL;
+			}else if(cond != UNLINK_REQUIRED && cond != REBALANCE_REQUIRED){
+				atomic_store_explicit(&n->height, cond, memory_order_relaxed);
+				next = atomic_load(&n->parent);
+			}
+			unlockNode(n);
+			n = next;
+			continue;
+		}
+
+		parent = atomic_load(&n->parent);
+		lockNode(parent);
+		next = n; // Moved or parent gone, go round again
+		below[0] = below[1] = NULL;
+		if(!(atomic_load(&parent->version) & UNLINKED) && atomic_load(&n->parent) == parent){
+			// Unlinked nodes keep their old parent link, so check n is still in
+			lockNode(n);
+			next = (atomic_load(&n->version) & UNLINKED) ? NULL : rebalance(t, parent, n, below);
+			unlockNode(n);
+		}
+		unlockNode(parent);
+
+		if(below[0] != NULL) fixPath(t, below[0]);
+		if(below[1] != NULL) fixPath(t, below[1]);
+		n = next;
+	}
+}
+
+/**	Add data under node, where child dir was seen empty. Returns RETRY if
+	node changed since nodeV, 1 if the spot filled meanwhile.
+**/
+static int attach(struct avlc *t, struct avlcNode *node, int dir, uint64_t nodeV, data_t data){
+	struct avlcNode *n = malloc(sizeof(*n));
+	if(n == NULL) return -1;
+
+	n->data = data;
+	atomic_init(&n->version, 0);
+	atomic_init(&n->present, 1);
+	atomic_init(&n->height, 1);
+	atomic_init(&n->lock, 0);
+	atomic_init(&n->parent, node);
+	atomic_init(&n->child[LEFT], NULL);
+	atomic_init(&n->child[RIGHT], NULL);
+	n->next = NULL;
+
+	lockNode(node);
+	int ret = (atomic_load(&node->version) != nodeV) ? RETRY : (getChild(node, dir) != NULL);
+	if(!ret) atomic_store(&node->child[dir], n);
+	unlockNode(node);
+
+	if(ret){
+		free(n);
+		return ret;
+	}
+
+	fixPath(t, node);
+	return 0;
+}
+
+/**	Insert or remove data in n, which holds it. Returns RETRY if n has been
+	unlinked, since data may be in a new node by now.
+**/
+static int setPresent(struct avlc *t, struct avlcNode *n, int present){
+	lockNode(n);
+	if(atomic_load(&n->version) & UNLINKED){
+		unlockNode(n);
+		return RETRY;
+	}
+	if(atomic_load(&n->present) == present){
+		unlockNode(n);
+		return -1;
+	}
+	atomic_store(&n->present, present);
+	unlockNode(n);
+
+	// Node with two children stays as routing node, others are unlinked by fixPath
+	if(!present) fixPath(t, n);
+
+	return 0;
+}
+
+/**	Writer search, validated the same way as attemptFind. Returns 0 if data
+	was inserted (or removed), -1 if already present (or missing) or out of
+	memory, RETRY if node changed.
+**/
+static int attemptUpdate(struct avlc *t, struct avlcNode *node, int dir, uint64_t nodeV, data_t data, int insert){
+	struct avlcNode *child;
+	uint64_t childV;
+	int res;
+
+	while(1){
+		child = getChild(node, dir);
+		if(atomic_load(&node->version) != nodeV) return RETRY;
+
+		if(child == NULL){
+			if(!insert) return -1;
+
+			res = attach(t, node, dir, nodeV, data);
+			if(res == 1) continue;
+			return res;
+		}
+		if(child->data == data){
+			res = setPresent(t, child, insert);
+			if(res != RETRY) return res;
+			continue;
+		}
+
+		childV = atomic_load(&child->version);
+		if(childV & SHRINKING){
+			while(atomic_load(&child->version) == childV) sched_yield();
+			continue;
+		}
+		if(childV & UNLINKED) continue;
+		if(getChild(node, dir) != child) continue;
+		if(atomic_load(&node->version) != nodeV) return RETRY;
+
+		res = attemptUpdate(t, child, (child->data > data) ? LEFT : RIGHT, childV, data, insert);
+		if(res != RETRY) return res;
+	}
+}
+
+int avlcInsert(struct avlc *t, int tid, data_t data){
+	if(t == NULL || tid < 0 || tid >= t->threads) return -1;
+
+	epochEnter(t, tid);
+	int ret = attemptUpdate(t, &t->holder, RIGHT, 0, data, 1);
+	epochExit(t, tid);
+
+	if(!ret) atomic_fetch_add(&t->size, 1);
+
+	return ret;
+}
+
+int avlcRemove(struct avlc *t, int tid, data_t data){
+	if(t == NULL || tid < 0 || tid >= t->threads) return -1;
+
+	epochEnter(t, tid);
+	int ret = attemptUpdate(t, &t->holder, RIGHT, 0, data, 0);
+	epochExit(t, tid);
+
+	if(!ret) atomic_fetch_sub(&t->size, 1);
+
+	return ret;
+}
+
+size_t avlcSize(struct avlc *t){
+	return (t != NULL) ? atomic_load(&t->size) : 0;
+}
+
+int avlcInit(struct avlc *t, int threads){
+	if(t == NULL || threads <= 0) return -1;
+
+	t->slots = aligned_alloc(AVLC_CACHE_LINE, threads * sizeof(*t->slots));
+	if(t->slots == NULL) return -1;
+	for(int i = 0;i < threads;i++){
+		atomic_init(&t->slots[i].epoch, 0);
+	}
+
+	if(pthread_mutex_init(&t->retireLock, NULL)){
+		free(t->slots);
+		return -1;
+	}
+
+	t->holder.data = 0;
+	atomic_init(&t->holder.version, 0);
+	atomic_init(&t->holder.present, 0);
+	atomic_init(&t->holder.height, 0);
+	atomic_init(&t->holder.lock, 0);
+	atomic_init(&t->holder.parent, NULL);
+	atomic_init(&t->holder.child[LEFT], NULL);
+	atomic_init(&t->holder.child[RIGHT], NULL);
+	t->holder.next = NULL;
+
+	atomic_init(&t->size, 0);
+	atomic_init(&t->epoch, 1);
+	for(int i = 0;i < 3;i++){
+		t->retired[i] = NULL;
+	}
+	t->pending = 0;
+	t->threads = threads;
+
+	return 0;
+}
+
+static void freeTree(struct avlcNode *n){
+	if(n == NULL) return;
+
+	freeTree(getChild(n, LEFT));
+	freeTree(getChild(n, RIGHT));
+	free(n);
+}
+
+void avlcDestroy(struct avlc *t){
+	if(t == NULL) return;
+
+	freeTree(getChild(&t->holder, RIGHT));
+	atomic_store(&t->holder.child[RIGHT], NULL);
+	for(int i = 0;i < 3;i++){
+		freeList(t->retired[i]);
+		t->retired[i] = NULL;
+	}
+
+	pthread_mutex_destroy(&t->retireLock);
+	free(t->slots);
+	t->slots = NULL;
+	t->threads = 0;
+}
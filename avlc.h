@@ -0,0 +1,82 @@
+/*
+	avlc.h -- Concurrent AVL tree with optimistic readers
+
+	Copyright (C) 2020 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#ifndef AVLC_H_
+#define AVLC_H_
+
+#include<stdint.h>
+#include<stdatomic.h>
+#include<pthread.h>
+#include"avl.h"
+
+#define AVLC_CACHE_LINE 64
+
+/**	Node for the concurrent tree. Readers never lock, and instead check the
+	version of each node they pass through (Bronson et al. style). A version
+	flagged shrinking means keys are being rotated out of the node's subtree.
+	Writers search the same way, then lock just the nodes they change.
+**/
+struct avlcNode{
+	data_t data;
+	_Atomic uint64_t version;		// Change count << 2 | unlinked << 1 | shrinking
+	atomic_int present;			// 0 for routing nodes left by remove
+	atomic_int height;			// Set under lock, only a hint to anyone else
+	atomic_int lock;			// Writer spinlock
+	_Atomic(struct avlcNode *) parent;	// Changed only under the old parent's lock
+	_Atomic(struct avlcNode *) child[2];	// Left, right
+	struct avlcNode *next;			// Retired list link
+};
+
+// Per-thread epoch announcement, one per cache line
+struct avlcSlot{
+	_Atomic uint64_t epoch;			// Epoch << 1 | active, 0 when idle
+	char pad[AVLC_CACHE_LINE - sizeof(uint64_t)];
+};
+
+/**	Tree handle. Unlinked nodes are retired and only freed once every thread
+	(reader or writer) has moved past the epoch they were unlinked in.
+**/
+struct avlc{
+	struct avlcNode holder;			// Root is right child of holder
+	pthread_mutex_t retireLock;		// Guards the retired lists and epoch advance
+	atomic_size_t size;
+	_Atomic uint64_t epoch;
+	struct avlcNode *retired[3];		// Retired nodes by epoch
+	size_t pending;				// Count of retired nodes
+	struct avlcSlot *slots;
+	int threads;
+};
+
+// Return 0 if initialized, non-zero otherwise. Thread ids are in [0, threads)
+int avlcInit(struct avlc *, int threads);
+
+// Return  0 if inserted, non-zero otherwise. Safe from any number of threads
+int avlcInsert(struct avlc *, int tid, data_t data);
+
+// Return 0 if removed, non-zero otherwise. Safe from any number of threads
+int avlcRemove(struct avlc *, int tid, data_t data);
+
+// Return non-zero if found, 0 otherwise. Lock free, tid picks the epoch slot
+int avlcFind(struct avlc *, int tid, data_t data);
+
+size_t avlcSize(struct avlc *);
+
+// Free up entire tree. No other thread may be using it
+void avlcDestroy(struct avlc *);
+
+#endif
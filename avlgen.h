@@ -0,0 +1,222 @@
+/*
+	avlgen.h -- Generator for type specialized AVL maps
+
+	Copyright (C) 2020 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#ifndef AVLGEN_H_
+#define AVLGEN_H_
+
+#include<stdlib.h>
+#include<stddef.h>
+
+// Default comparator for anything with < and >
+#define AVL_CMP_NUM(a, b) (((a) > (b)) - ((a) < (b)))
+
+/**	AVL_DEFINE(name, key_t, val_t, cmp) emits struct name (the map),
+	struct name_node, and static inline functions:
+
+		int name_insert(struct name *, key_t, val_t)	0 if inserted, non-zero if key exists
+		val_t *name_find(const struct name *, key_t)	NULL if key is missing
+		int name_remove(struct name *, key_t, val_t *)	0 if removed (value stored if non-NULL)
+		size_t name_size(const struct name *)
+		void name_destroy(struct name *)
+
+	cmp(a, b) returns <0, 0, >0 like strcmp, and may be a macro or inline
+	function so it is inlined into every comparison. Same algorithm as avl.c
+	(height and size per node, rotate on the way back up).
+	A map starts out zeroed: struct name map = {NULL};
+**/
+#define AVL_DEFINE(name, key_t, val_t, cmp)								\
+struct name##_node{											\
+	key_t key;											\
+	val_t val;											\
+	size_t size;				/* Size of subtree, including this node */		\
+	size_t height;											\
+	struct name##_node *left;									\
+	struct name##_node *right;									\
+};													\
+													\
+struct name{												\
+	struct name##_node *root;									\
+};													\
+													\
+static inline size_t name##_nodeHeight(const struct name##_node *n){					\
+	return (n != NULL) ? n->height : 0;								\
+}													\
+static inline size_t name##_nodeSize(const struct name##_node *n){					\
+	return (n != NULL) ? n->size : 0;								\
+}													\
+static inline void name##_update(struct name##_node *n){						\
+	size_t left = name##_nodeHeight(n->left);							\
+	size_t right = name##_nodeHeight(n->right);							\
+	n->height = ((left > right) ? left : right) + 1;						\
+	n->size = name##_nodeSize(n->left) + name##_nodeSize(n->right) + 1;				\
+}													\
+													\
+/* Right child replaces n */										\
+static inline struct name##_node *name##_rotateLeft(struct name##_node *n){				\
+	struct name##_node *child = n->right;								\
+	n->right = child->left;										\
+	child->left = n;										\
+	name##_update(n);										\
+	name##_update(child);										\
+	return child;											\
+}													\
+/* Left child replaces n */										\
+static inline struct name##_node *name##_rotateRight(struct name##_node *n){				\
+	struct name##_node *child = n->left;								\
+	n->left = child->right;										\
+	child->right = n;										\
+	name##_update(n);										\
+	name##_update(child);										\
+	return child;											\
+}													\
+													\
+/* Update n and do single or double rotation if it is off by 2 */					\
+static inline struct name##_node *name##_rebalance(struct name##_node *n){				\
+	name##_update(n);										\
+	size_t left = name##_nodeHeight(n->left);							\
+	size_t right = name##_nodeHeight(n->right);							\
+													\
+	if(left > right + 1){										\
+		if(name##_nodeHeight(n->left->right) > name##_nodeHeight(n->left->left)){		\
+			n->left = name##_rotateLeft(n->left);						\
+		}											\
+		return name##_rotateRight(n);								\
+	}else if(right > left + 1){									\
+		if(name##_nodeHeight(n->right->left) > name##_nodeHeight(n->right->right)){		\
+			n->right = name##_rotateRight(n->right);					\
+		}											\
+		return name##_rotateLeft(n);								\
+	}												\
+													\
+	return n;											\
+}													\
+													\
+static inline struct name##_node *name##_insertNode(struct name##_node *n, key_t key, val_t val, int *ret){ \
+	if(n == NULL){											\
+		n = malloc(sizeof(*n));									\
+		if(n == NULL){										\
+			*ret = -1;									\
+			return NULL;									\
+		}											\
+		n->key = key;										\
+		n->val = val;										\
+		n->size = 1;										\
+		n->height = 1;										\
+		n->left = NULL;										\
+		n->right = NULL;									\
+		*ret = 0;										\
+		return n;										\
+	}												\
+													\
+	int c = cmp(key, n->key);									\
+	if(c < 0){											\
+		n->left = name##_insertNode(n->left, key, val, ret);					\
+	}else if(c > 0){										\
+		n->right = name##_insertNode(n->right, key, val, ret);					\
+	}else{												\
+		*ret = -1; /* Key already exists */							\
+		return n;										\
+	}												\
+													\
+	return (*ret) ? n : name##_rebalance(n);							\
+}													\
+													\
+static inline int name##_insert(struct name *t, key_t key, val_t val){					\
+	int ret = -1;											\
+	if(t != NULL) t->root = name##_insertNode(t->root, key, val, &ret);				\
+	return ret;											\
+}													\
+													\
+static inline val_t *name##_find(const struct name *t, key_t key){					\
+	struct name##_node *n = (t != NULL) ? t->root : NULL;						\
+	int c;												\
+	while(n != NULL){										\
+		c = cmp(key, n->key);									\
+		if(c < 0) n = n->left;									\
+		else if(c > 0) n = n->right;								\
+		else return &n->val;									\
+	}												\
+	return NULL;											\
+}													\
+													\
+/* Unlink min of subtree n, handing it back through min */						\
+static inline struct name##_node *name##_removeMin(struct name##_node *n, struct name##_node **min){	\
+	if(n->left == NULL){										\
+		*min = n;										\
+		return n->right;									\
+	}												\
+	n->left = name##_removeMin(n->left, min);							\
+	return name##_rebalance(n);									\
+}													\
+													\
+static inline struct name##_node *name##_removeNode(struct name##_node *n, key_t key, val_t *val, int *ret){ \
+	if(n == NULL){											\
+		*ret = -1;										\
+		return NULL;										\
+	}												\
+													\
+	int c = cmp(key, n->key);									\
+	if(c < 0){											\
+		n->left = name##_removeNode(n->left, key, val, ret);					\
+	}else if(c > 0){										\
+		n->right = name##_removeNode(n->right, key, val, ret);					\
+	}else{												\
+		struct name##_node *old = n;								\
+		if(val != NULL) *val = n->val;								\
+		*ret = 0;										\
+													\
+		if(n->right == NULL){									\
+			n = n->left;									\
+		}else{											\
+			/* Successor takes the place of removed node */					\
+			struct name##_node *right = name##_removeMin(n->right, &n);			\
+			n->left = old->left;								\
+			n->right = right;								\
+			n = name##_rebalance(n);							\
+		}											\
+													\
+		free(old);										\
+		return n;										\
+	}												\
+													\
+	return (*ret) ? n : name##_rebalance(n);							\
+}													\
+													\
+static inline int name##_remove(struct name *t, key_t key, val_t *val){				\
+	int ret = -1;											\
+	if(t != NULL) t->root = name##_removeNode(t->root, key, val, &ret);				\
+	return ret;											\
+}													\
+													\
+static inline size_t name##_size(const struct name *t){						\
+	return (t != NULL) ? name##_nodeSize(t->root) : 0;						\
+}													\
+													\
+static inline void name##_destroyNode(struct name##_node *n){						\
+	if(n == NULL) return;										\
+	name##_destroyNode(n->left);									\
+	name##_destroyNode(n->right);									\
+	free(n);											\
+}													\
+static inline void name##_destroy(struct name *t){							\
+	if(t == NULL) return;										\
+	name##_destroyNode(t->root);									\
+	t->root = NULL;											\
+}
+
+#endif
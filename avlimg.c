@@ -0,0 +1,294 @@
+/*
+	avlimg.c -- Memory-mapped on-disk image of an AVL tree
+
+	Copyright (C) 2020 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include"avlimg.h"
+
+/**	Pre-order walk. Since every node knows its subtree size, the right child
+	lands 1 + size(left) nodes after its parent, so nodes can be written out
+	as they are visited.
+**/
+int avlImgSave(const struct node *tree, const char *path){
+	if(path == NULL) return -1;
+
+	FILE *fp = fopen(path, "wb");
+	if(fp == NULL) return -1;
+
+	struct avlImgHeader head = {0};
+	head.magic = AVLIMG_MAGIC;
+	head.version = AVLIMG_VERSION;
+	head.dataSize = sizeof(data_t);
+	head.count = size(tree);
+
+	int ret = (fwrite(&head, sizeof(head), 1, fp) != 1);
+
+	// Right child waits on the stack while the left subtree is written
+	const struct node *stack[AVL_MAX_HEIGHT + 1];
+	int depth = 0;
+	if(tree != NULL) stack[depth++] = tree;
+
+	struct avlImgNode out;
+	while(depth > 0 && !ret){
+		tree = stack[--depth];
+
+		out.data = tree->data;
+		out.size = tree->size;
+		out.left = (tree->left != NULL);
+		out.right = (tree->right != NULL) ? 1 + size(tree->left) : 0;
+		ret = (fwrite(&out, sizeof(out), 1, fp) != 1);
+
+		if(tree->right != NULL) stack[depth++] = tree->right;
+		if(tree->left != NULL) stack[depth++] = tree->left;
+	}
+
+	if(fflush(fp) || fsync(fileno(fp))) ret = -1;
+	if(fclose(fp)) ret = -1;
+
+	return ret;
+}
+
+/**	Check the links match what avlImgSave writes, so the walks below only
+	ever step forward and stay inside the image: left is 0 or 1, right is
+	just past the left subtree, and every size adds up and fits in what is
+	left of the image. Subtrees must also be AVL balanced and no taller than
+	AVL_MAX_HEIGHT, or the iterator stacks would cut off keys. Children
+	follow their parent, so walking backwards sees them first.
+**/
+static int imageCheck(const struct avlImgNode *nodes, uint64_t count){
+	if(count && nodes[0].size != count) return -1;
+
+	uint8_t *height = malloc(count);
+	if(height == NULL && count) return -1;
+
+	uint64_t l, r;
+	int lh, rh, ret = 0;
+	for(uint64_t i = count;i-- > 0;){
+		ret = -1;
+		if(nodes[i].left > 1 || (nodes[i].left && i + 1 >= count)) break;
+		l = (nodes[i].left) ? nodes[i+1].size : 0;
+
+		if(nodes[i].right && (nodes[i].right != 1 + l || nodes[i].right >= count - i)) break;
+		r = (nodes[i].right) ? nodes[i + nodes[i].right].size : 0;
+
+		if(nodes[i].size > count - i || nodes[i].size != 1 + l + r) break;
+
+		lh = (nodes[i].left) ? height[i+1] : 0;
+		rh = (nodes[i].right) ? height[i + nodes[i].right] : 0;
+		if(lh - rh > 1 || rh - lh > 1) break;
+
+		height[i] = ((lh > rh) ? lh : rh) + 1;
+		if(height[i] > AVL_MAX_HEIGHT) break;
+		ret = 0;
+	}
+
+	free(height);
+	return ret;
+}
+
+int avlImgLoad(struct avlImg *img, const char *path){
+	if(img == NULL || path == NULL) return -1;
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return -1;
+
+	struct stat st;
+	if(fstat(fd, &st) || (size_t)st.st_size < sizeof(struct avlImgHeader)){
+		close(fd);
+		return -1;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); // Mapping keeps its own reference
+	if(map == MAP_FAILED) return -1;
+
+	const struct avlImgHeader *head = map;
+	if(head->magic != AVLIMG_MAGIC || head->version != AVLIMG_VERSION || head->dataSize != sizeof(data_t)
+		|| head->count > (st.st_size - sizeof(*head)) / sizeof(struct avlImgNode)
+		|| sizeof(*head) + head->count * sizeof(struct avlImgNode) != (size_t)st.st_size){
+		munmap(map, st.st_size);
+		return -1;
+	}
+
+	img->nodes = (const struct avlImgNode *)(head + 1);
+	img->count = head->count;
+	if(imageCheck(img->nodes, img->count)){
+		munmap(map, st.st_size);
+		return -1;
+	}
+
+	img->map = map;
+	img->mapLen = st.st_size;
+	img->added = NULL;
+	img->removed = NULL;
+
+	return 0;
+}
+
+// Search the mapped nodes only
+static int imageFind(const struct avlImg *img, data_t data){
+	if(img->count == 0) return 0;
+
+	const struct avlImgNode *n = img->nodes;
+	uint64_t off;
+	for(;;){
+		if(n->data > data){
+			off = n->left;
+		}else if(n->data < data){
+			off = n->right;
+		}else{
+			return 1;
+		}
+
+		if(off == 0) return 0;
+		n += off;
+	}
+}
+
+int avlImgFind(const struct avlImg *img, data_t data){
+	if(img == NULL) return 0;
+
+	if(imageFind(img, data)) return !avlFind(img->removed, data, NULL);
+
+	return avlFind(img->added, data, NULL);
+}
+
+/**	Same cursor as struct avlIter, over node pointers into the mapping
+**/
+struct imageIter{
+	const struct avlImgNode *stack[AVL_MAX_HEIGHT];
+	int depth;
+};
+
+static void imageSeek(struct imageIter *it, const struct avlImg *img, data_t data){
+	const struct avlImgNode *n = (img->count) ? img->nodes : NULL;
+	uint64_t off;
+	int found = 0;
+
+	it->depth = 0;
+	while(n != NULL && it->depth < AVL_MAX_HEIGHT){
+		it->stack[it->depth++] = n;
+
+		if(n->data > data){
+			found = it->depth;
+			off = n->left;
+		}else if(n->data < data){
+			off = n->right;
+		}else{
+			found = it->depth;
+			break;
+		}
+
+		n = (off) ? n + off : NULL;
+	}
+
+	it->depth = found;
+}
+
+static void imageForward(struct imageIter *it){
+	const struct avlImgNode *child = it->stack[it->depth-1];
+	if(child->right){
+		child += child->right;
+		while(it->depth < AVL_MAX_HEIGHT){
+			it->stack[it->depth++] = child;
+			if(child->left == 0) break;
+			child += child->left;
+		}
+		return;
+	}
+
+	const struct avlImgNode *parent;
+	do{
+		child = it->stack[--it->depth];
+		parent = (it->depth > 0) ? it->stack[it->depth-1] : NULL;
+	}while(parent != NULL && parent->right && parent + parent->right == child);
+}
+
+/**	Merge the image and added keys, both in order, skipping removed keys.
+	The two never hold the same key.
+**/
+size_t avlImgRange(const struct avlImg *img, data_t lo, data_t hi, data_t *out, size_t max){
+	if(img == NULL) return 0;
+
+	struct imageIter a;
+	struct avlIter b;
+	imageSeek(&a, img, lo);
+	avlIterSeek(&b, img->added, lo);
+
+	size_t cnt = 0;
+	int hasA, hasB;
+	data_t va, vb;
+	while(cnt < max){
+		hasA = (a.depth > 0 && (va = a.stack[a.depth-1]->data) < hi);
+		hasB = (b.depth > 0 && (vb = b.stack[b.depth-1]->data) < hi);
+
+		if(hasA && (!hasB || va < vb)){
+			imageForward(&a);
+			if(img->removed != NULL && avlFind(img->removed, va, NULL)) continue;
+			out[cnt++] = va;
+		}else if(hasB){
+			avlIterNext(&b, NULL);
+			out[cnt++] = vb;
+		}else{
+			break;
+		}
+	}
+
+	return cnt;
+}
+
+int avlImgInsert(struct avlImg *img, data_t data){
+	if(img == NULL) return -1;
+
+	if(imageFind(img, data)){
+		// Only possible if it was removed since load
+		return avlRemove(&img->removed, data);
+	}
+
+	return avlInsert(&img->added, data);
+}
+
+int avlImgRemove(struct avlImg *img, data_t data){
+	if(img == NULL) return -1;
+
+	if(avlRemove(&img->added, data) == 0) return 0;
+	if(!imageFind(img, data)) return -1;
+
+	return avlInsert(&img->removed, data);
+}
+
+size_t avlImgSize(const struct avlImg *img){
+	if(img == NULL) return 0;
+
+	return img->count + size(img->added) - size(img->removed);
+}
+
+void avlImgClose(struct avlImg *img){
+	if(img == NULL) return;
+
+	if(img->map != NULL) munmap(img->map, img->mapLen);
+	destroy(&img->added);
+	destroy(&img->removed);
+
+	img->nodes = NULL;
+	img->count = 0;
+	img->map = NULL;
+	img->mapLen = 0;
+}
@@ -0,0 +1,82 @@
+/*
+	avlimg.h -- Memory-mapped on-disk image of an AVL tree
+
+	Copyright (C) 2020 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#ifndef AVLIMG_H_
+#define AVLIMG_H_
+
+#include<stdint.h>
+#include"avl.h"
+
+#define AVLIMG_MAGIC 0x31474D494C5641ULL	// "AVLIMG1" little endian
+#define AVLIMG_VERSION 1
+
+/**	File is a 64 byte header followed by the nodes in pre-order, so the root
+	is node 0 and a left child always directly follows its parent. Children
+	are stored as distance in nodes from the parent, which keeps the file
+	valid wherever it gets mapped. Integers are in host byte order.
+**/
+struct avlImgHeader{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t dataSize;		// sizeof(data_t) of the writer
+	uint64_t count;			// Number of nodes
+	uint64_t reserved[5];
+};
+
+struct avlImgNode{
+	data_t data;
+	uint64_t size;			// Size of subtree, including this node
+	uint64_t left;			// Distance to left child, 0 if none
+	uint64_t right;			// Distance to right child, 0 if none
+};
+
+/**	Loaded image. The mapping is read-only, so changes after load go to two
+	small heap trees: keys added that the image lacks, and image keys removed.
+**/
+struct avlImg{
+	const struct avlImgNode *nodes;
+	size_t count;			// Nodes in image
+	void *map;
+	size_t mapLen;
+	struct node *added;
+	struct node *removed;
+};
+
+// Write tree to path. Return 0 if written, non-zero otherwise
+int avlImgSave(const struct node *, const char *path);
+
+// Map image at path. Return 0 if loaded, non-zero otherwise
+int avlImgLoad(struct avlImg *, const char *path);
+
+// Return non-zero if found, 0 otherwise
+int avlImgFind(const struct avlImg *, data_t data);
+
+// Copy up to max items in [lo, hi) into out, in order. Return count
+size_t avlImgRange(const struct avlImg *, data_t lo, data_t hi, data_t *out, size_t max);
+
+// Return 0 if inserted/removed, non-zero otherwise. Image file is not changed
+int avlImgInsert(struct avlImg *, data_t data);
+int avlImgRemove(struct avlImg *, data_t data);
+
+// Get total number of items, including changes since load
+size_t avlImgSize(const struct avlImg *);
+
+// Unmap image and free pending changes
+void avlImgClose(struct avlImg *);
+
+#endif
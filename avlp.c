@@ -0,0 +1,324 @@
+/*
+	avlp.c -- Persistent (path copying) AVL tree with shared snapshots
+
+	Copyright (C) 2020 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#include<sched.h>
+#include"avlp.h"
+
+static inline size_t heightOf(const struct avlpNode *n){
+	return (n != NULL) ? n->height : 0;
+}
+
+static inline void updateNode(struct avlpNode *n){
+	size_t left = heightOf(n->left);
+	size_t right = heightOf(n->right);
+
+	n->height = ((left > right) ? left : right) + 1;
+	n->size = avlpSize(n->left) + avlpSize(n->right) + 1;
+}
+
+struct avlpNode *avlpRetain(struct avlpNode *n){
+	if(n != NULL) atomic_fetch_add_explicit(&n->refs, 1, memory_order_relaxed);
+	return n;
+}
+
+void avlpRelease(struct avlpNode *n){
+	if(n == NULL) return;
+	if(atomic_fetch_sub_explicit(&n->refs, 1, memory_order_acq_rel) != 1) return;
+
+	avlpRelease(n->left);
+	avlpRelease(n->right);
+	free(n);
+}
+
+/**	New node taking over the given child references.
+	On failure the children are released and NULL returned.
+**/
+static struct avlpNode *newNode(data_t data, struct avlpNode *left, struct avlpNode *right){
+	struct avlpNode *n = malloc(sizeof(*n));
+	if(n == NULL){
+		avlpRelease(left);
+		avlpRelease(right);
+		return NULL;
+	}
+
+	n->data = data;
+	n->left = left;
+	n->right = right;
+	atomic_init(&n->refs, 1);
+	updateNode(n);
+
+	return n;
+}
+
+/**	Trade a reference for one that can be changed in place. A count of 1
+	means only the caller's (fresh) parent can see the node, otherwise copy.
+**/
+static struct avlpNode *own(struct avlpNode *n){
+	if(atomic_load_explicit(&n->refs, memory_order_acquire) == 1) return n;
+
+	struct avlpNode *copy = newNode(n->data, avlpRetain(n->left), avlpRetain(n->right));
+	avlpRelease(n);
+
+	return copy;
+}
+
+/**	Rotations and rebalance take an owned node and return the owned new
+	subtree root, or NULL (with everything released) if a copy failed.
+**/
+static struct avlpNode *rotateLeft(struct avlpNode *n){
+	struct avlpNode *child = own(n->right);
+	n->right = child;
+	if(child == NULL){
+		avlpRelease(n);
+		return NULL;
+	}
+
+	n->right = child->left;
+	child->left = n;
+	updateNode(n);
+	updateNode(child);
+
+	return child;
+}
+static struct avlpNode *rotateRight(struct avlpNode *n){
+	struct avlpNode *child = own(n->left);
+	n->left = child;
+	if(child == NULL){
+		avlpRelease(n);
+		return NULL;
+	}
+
+	n->left = child->right;
+	child->right = n;
+	updateNode(n);
+	updateNode(child);
+
+	return child;
+}
+
+static struct avlpNode *rebalance(struct avlpNode *n){
+	size_t left = heightOf(n->left);
+	size_t right = heightOf(n->right);
+
+	if(left > right + 1){
+		if(heightOf(n->left->right) > heightOf(n->left->left)){
+			// Left-right, child has to be owned before rotating it
+			n->left = own(n->left);
+			if(n->left != NULL) n->left = rotateLeft(n->left);
+			if(n->left == NULL){
+				avlpRelease(n);
+				return NULL;
+			}
+		}
+		return rotateRight(n);
+	}else if(right > left + 1){
+		if(heightOf(n->right->left) > heightOf(n->right->right)){
+			n->right = own(n->right);
+			if(n->right != NULL) n->right = rotateRight(n->right);
+			if(n->right == NULL){
+				avlpRelease(n);
+				return NULL;
+			}
+		}
+		return rotateLeft(n);
+	}
+
+	return n;
+}
+
+/**	Recursive updates on a borrowed subtree, returning an owned new subtree.
+	ret is 0 on change, 1 if nothing to change, -1 if out of memory.
+**/
+static struct avlpNode *insertNode(struct avlpNode *n, data_t data, int *ret){
+	struct avlpNode *copy;
+
+	if(n == NULL){
+		copy = newNode(data, NULL, NULL);
+		*ret = (copy == NULL) ? -1 : 0;
+		return copy;
+	}
+
+	if(n->data > data){
+		struct avlpNode *left = insertNode(n->left, data, ret);
+		if(*ret) return NULL;
+		copy = newNode(n->data, left, avlpRetain(n->right));
+	}else if(n->data < data){
+		struct avlpNode *right = insertNode(n->right, data, ret);
+		if(*ret) return NULL;
+		copy = newNode(n->data, avlpRetain(n->left), right);
+	}else{
+		*ret = 1; // Duplicate
+		return NULL;
+	}
+
+	if(copy != NULL) copy = rebalance(copy);
+	if(copy == NULL) *ret = -1;
+
+	return copy;
+}
+
+static struct avlpNode *removeMin(struct avlpNode *n, data_t *min, int *ret){
+	if(n->left == NULL){
+		*min = n->data;
+		*ret = 0;
+		return avlpRetain(n->right);
+	}
+
+	struct avlpNode *left = removeMin(n->left, min, ret);
+	if(*ret) return NULL;
+
+	struct avlpNode *copy = newNode(n->data, left, avlpRetain(n->right));
+	if(copy != NULL) copy = rebalance(copy);
+	if(copy == NULL) *ret = -1;
+
+	return copy;
+}
+
+static struct avlpNode *removeNode(struct avlpNode *n, data_t data, int *ret){
+	struct avlpNode *copy;
+
+	if(n == NULL){
+		*ret = 1; // Not found
+		return NULL;
+	}
+
+	if(n->data > data){
+		struct avlpNode *left = removeNode(n->left, data, ret);
+		if(*ret) return NULL;
+		copy = newNode(n->data, left, avlpRetain(n->right));
+	}else if(n->data < data){
+		struct avlpNode *right = removeNode(n->right, data, ret);
+		if(*ret) return NULL;
+		copy = newNode(n->data, avlpRetain(n->left), right);
+	}else{
+		*ret = 0;
+		if(n->left == NULL) return avlpRetain(n->right);
+		if(n->right == NULL) return avlpRetain(n->left);
+
+		// Min of right subtree takes the place of removed data
+		data_t min;
+		struct avlpNode *right = removeMin(n->right, &min, ret);
+		if(*ret) return NULL;
+		copy = newNode(min, avlpRetain(n->left), right);
+	}
+
+	if(copy != NULL) copy = rebalance(copy);
+	if(copy == NULL) *ret = -1;
+
+	return copy;
+}
+
+int avlpInsert(struct avlpNode *root, data_t data, struct avlpNode **out){
+	int ret;
+	struct avlpNode *res = insertNode(root, data, &ret);
+
+	*out = (ret) ? avlpRetain(root) : res;
+	return ret;
+}
+
+int avlpRemove(struct avlpNode *root, data_t data, struct avlpNode **out){
+	int ret;
+	struct avlpNode *res = removeNode(root, data, &ret);
+
+	*out = (ret) ? avlpRetain(root) : res;
+	return ret;
+}
+
+int avlpFind(const struct avlpNode *n, data_t data){
+	while(n != NULL){
+		if(n->data > data) n = n->left;
+		else if(n->data < data) n = n->right;
+		else return 1;
+	}
+
+	return 0;
+}
+
+size_t avlpSize(const struct avlpNode *n){
+	return (n != NULL) ? n->size : 0;
+}
+
+int avlpTreeInit(struct avlp *t){
+	if(t == NULL) return -1;
+
+	atomic_init(&t->root, NULL);
+	atomic_init(&t->epoch, 0);
+	atomic_init(&t->readers[0], 0);
+	atomic_init(&t->readers[1], 0);
+	if(pthread_mutex_init(&t->write, NULL)) return -1;
+
+	return 0;
+}
+
+struct avlpNode *avlpTreeSnapshot(struct avlp *t){
+	uint64_t e = atomic_load(&t->epoch);
+
+	atomic_fetch_add(&t->readers[e & 1], 1);
+	struct avlpNode *root = avlpRetain(atomic_load(&t->root));
+	atomic_fetch_sub(&t->readers[e & 1], 1);
+
+	return root;
+}
+
+/**	Swap in new version, old one lives on in any pinned snapshots. A reader
+	may have loaded the old root without retaining it yet, and it counted
+	itself in under one parity or the other before that load. The first
+	flip sends new readers to the other count so the old one drains, the
+	second does the same the other way round.
+**/
+static void publish(struct avlp *t, struct avlpNode *root){
+	struct avlpNode *old = atomic_exchange(&t->root, root);
+
+	for(int i = 0;i < 2;i++){
+		uint64_t e = atomic_fetch_add(&t->epoch, 1);
+		while(atomic_load(&t->readers[e & 1])) sched_yield();
+	}
+
+	avlpRelease(old);
+}
+
+int avlpTreeInsert(struct avlp *t, data_t data){
+	struct avlpNode *next;
+
+	pthread_mutex_lock(&t->write);
+	int ret = avlpInsert(atomic_load(&t->root), data, &next);
+	if(!ret) publish(t, next);
+	else avlpRelease(next);
+	pthread_mutex_unlock(&t->write);
+
+	return ret;
+}
+
+int avlpTreeRemove(struct avlp *t, data_t data){
+	struct avlpNode *next;
+
+	pthread_mutex_lock(&t->write);
+	int ret = avlpRemove(atomic_load(&t->root), data, &next);
+	if(!ret) publish(t, next);
+	else avlpRelease(next);
+	pthread_mutex_unlock(&t->write);
+
+	return ret;
+}
+
+void avlpTreeDestroy(struct avlp *t){
+	if(t == NULL) return;
+
+	avlpRelease(atomic_exchange(&t->root, NULL));
+	pthread_mutex_destroy(&t->write);
+}
@@ -0,0 +1,82 @@
+/*
+	avlp.h -- Persistent (path copying) AVL tree with shared snapshots
+
+	Copyright (C) 2020 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#ifndef AVLP_H_
+#define AVLP_H_
+
+#include<stdatomic.h>
+#include<pthread.h>
+#include"avl.h"
+
+/**	Nodes are never changed once they are part of a version. Updates copy the
+	search path and share everything else, so each node counts the parents
+	(and pinned roots) referencing it, and is freed when that drops to zero.
+**/
+struct avlpNode{
+	data_t data;
+	size_t size;			// Size of subtree, including this node
+	size_t height;
+	struct avlpNode *left;
+	struct avlpNode *right;
+	atomic_size_t refs;
+};
+
+/**	Versions. Root arguments are borrowed, and out always receives a new
+	reference to the resulting version (root itself when nothing changed).
+**/
+// Return  0 if inserted, non-zero otherwise
+int avlpInsert(struct avlpNode *root, data_t data, struct avlpNode **out);
+
+// Return 0 if removed, non-zero otherwise
+int avlpRemove(struct avlpNode *root, data_t data, struct avlpNode **out);
+
+// Return non-zero if found, 0 otherwise
+int avlpFind(const struct avlpNode *, data_t data);
+
+size_t avlpSize(const struct avlpNode *);
+
+// Take/drop a reference to a version
+struct avlpNode *avlpRetain(struct avlpNode *);
+void avlpRelease(struct avlpNode *);
+
+/**	Shared current version. Writers are serialized and publish a new root.
+	Readers pin a snapshot without locking or waiting, then use it without
+	any synchronization. A reader counts itself in under the epoch's parity
+	only while it loads and retains the root. Publishing flips the epoch
+	twice and waits out both counts before dropping the old root, so new
+	readers can't hold the writer up.
+**/
+struct avlp{
+	_Atomic(struct avlpNode *) root;
+	_Atomic uint64_t epoch;
+	atomic_size_t readers[2];	// Snapshots in progress, by epoch parity
+	pthread_mutex_t write;		// Serializes writers
+};
+
+int avlpTreeInit(struct avlp *);
+
+// Return pinned current version, release with avlpRelease. Never blocks
+struct avlpNode *avlpTreeSnapshot(struct avlp *);
+
+int avlpTreeInsert(struct avlp *, data_t data);
+int avlpTreeRemove(struct avlp *, data_t data);
+
+// Drop current version. Pinned snapshots stay valid until released
+void avlpTreeDestroy(struct avlp *);
+
+#endif
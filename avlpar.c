@@ -0,0 +1,380 @@
+/*
+	avlpar.c -- Multi-threaded fork-join operations on the AVL tree
+
+	Copyright (C) 2020 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#include<pthread.h>
+#include<stdatomic.h>
+#include"avlpar.h"
+
+#define PAR_DEQUE 64		// Forks waiting per worker. Recursion is O(log n), so never filled in practice
+
+enum parOp{
+	PAR_UNION,
+	PAR_INTERSECT,
+	PAR_DIFFERENCE,
+	PAR_FILTER,
+	PAR_BUILD
+};
+
+/**	One half of a recursive call, which may be stolen by another worker
+**/
+struct parTask{
+	enum parOp op;
+	struct node *a;
+	struct node *b;
+	const data_t *keys;
+	size_t n;
+	struct node *ret;
+	int forked;
+	int stolen;				// Set by the thief, so its owner may be asleep on it
+	atomic_int done;
+};
+
+/**	Owner pushes and pops forks at the tail, thieves take the oldest (and
+	biggest) from the head. Forks are rare next to the work under them, so
+	a lock per deque is cheap enough.
+**/
+struct parWorker{
+	struct parCtx *ctx;
+	unsigned seed;
+	pthread_t tid;
+	pthread_mutex_t lock;
+	struct parTask *tasks[PAR_DEQUE];
+	int head, tail;
+};
+
+// Shared by every worker of one operation
+struct parCtx{
+	struct parWorker *workers;
+	int count;
+	atomic_int stop;
+	atomic_int pending;		// Tasks sitting in deques
+	atomic_int sleeping;	// Workers waiting on idle, for a fork or a stolen task to finish
+	pthread_mutex_t idleLock;
+	pthread_cond_t idle;
+	int (*keep)(data_t, void *);
+	void *arg;
+};
+
+static void runTask(struct parWorker *, struct parTask *);
+
+// Take the oldest task of some other worker, NULL if all are empty
+static struct parTask *steal(struct parWorker *w){
+	struct parCtx *ctx = w->ctx;
+	struct parTask *task = NULL;
+	struct parWorker *v;
+
+	w->seed = w->seed * 1103515245 + 12345;
+	int first = (w->seed >> 16) % ctx->count;
+	for(int i = 0;i < ctx->count && task == NULL;i++){
+		v = ctx->workers + (first + i) % ctx->count;
+		if(v == w) continue;
+
+		pthread_mutex_lock(&v->lock);
+		if(v->head < v->tail){
+			task = v->tasks[v->head++];
+			task->stolen = 1;
+			if(v->head == v->tail) v->head = v->tail = 0;
+			atomic_fetch_sub(&ctx->pending, 1);
+		}
+		pthread_mutex_unlock(&v->lock);
+	}
+
+	return task;
+}
+
+/**	Steal until nothing is pending, then sleep until a fork or the end of
+	the operation. Sleepers count themselves before checking pending, and
+	forks count before checking for sleepers, so one of them always sees
+	the other.
+**/
+static void wake(struct parCtx *ctx){
+	if(!atomic_load(&ctx->sleeping)) return;
+
+	pthread_mutex_lock(&ctx->idleLock);
+	pthread_cond_broadcast(&ctx->idle);
+	pthread_mutex_unlock(&ctx->idleLock);
+}
+
+static void *workerThread(void *arg){
+	struct parWorker *w = arg;
+	struct parCtx *ctx = w->ctx;
+	struct parTask *task;
+
+	while(!atomic_load(&ctx->stop)){
+		task = steal(w);
+		if(task != NULL){
+			runTask(w, task);
+			continue;
+		}
+
+		pthread_mutex_lock(&ctx->idleLock);
+		atomic_fetch_add(&ctx->sleeping, 1);
+		while(!atomic_load(&ctx->pending) && !atomic_load(&ctx->stop)){
+			pthread_cond_wait(&ctx->idle, &ctx->idleLock);
+		}
+		atomic_fetch_sub(&ctx->sleeping, 1);
+		pthread_mutex_unlock(&ctx->idleLock);
+	}
+
+	return NULL;
+}
+
+/**	Offer task to idle workers. If the deque is full (or there is no one to
+	steal it) it runs right here instead.
+**/
+static void forkTask(struct parWorker *w, struct parTask *task){
+	task->forked = 0;
+	task->stolen = 0;
+	atomic_init(&task->done, 0);
+
+	struct parCtx *ctx = w->ctx;
+	if(ctx->count > 1){
+		pthread_mutex_lock(&w->lock);
+		if(w->tail < PAR_DEQUE){
+			w->tasks[w->tail++] = task;
+			task->forked = 1;
+		}
+		pthread_mutex_unlock(&w->lock);
+	}
+
+	if(!task->forked){
+		runTask(w, task);
+		return;
+	}
+
+	atomic_fetch_add(&ctx->pending, 1);
+	wake(ctx);
+}
+
+/**	Run task here if nobody stole it. Otherwise help with other tasks until
+	the thief finishes it, sleeping while there are none.
+**/
+static void joinTask(struct parWorker *w, struct parTask *task){
+	if(!task->forked) return;
+
+	// Anything forked after task was joined already, so it is last if still here
+	pthread_mutex_lock(&w->lock);
+	int mine = (w->tail > w->head && w->tasks[w->tail-1] == task);
+	if(mine && --w->tail == w->head) w->head = w->tail = 0;
+	pthread_mutex_unlock(&w->lock);
+	if(mine) atomic_fetch_sub(&w->ctx->pending, 1);
+
+	if(mine){
+		runTask(w, task);
+		return;
+	}
+
+	struct parCtx *ctx = w->ctx;
+	struct parTask *other;
+	while(!atomic_load(&task->done)){
+		other = steal(w);
+		if(other != NULL){
+			runTask(w, other);
+			continue;
+		}
+
+		pthread_mutex_lock(&ctx->idleLock);
+		atomic_fetch_add(&ctx->sleeping, 1);
+		while(!atomic_load(&task->done) && !atomic_load(&ctx->pending)){
+			pthread_cond_wait(&ctx->idle, &ctx->idleLock);
+		}
+		atomic_fetch_sub(&ctx->sleeping, 1);
+		pthread_mutex_unlock(&ctx->idleLock);
+	}
+}
+
+/**	Same split/recurse/join as the sequential set operations, with the left
+	half forked. Small inputs go straight to the sequential version.
+**/
+static struct node *setOp(struct parWorker *w, enum parOp op, struct node *a, struct node *b){
+	if(a == NULL || b == NULL || size(a) + size(b) <= AVL_PAR_CUTOFF){
+		switch(op){
+			case PAR_UNION: return avlUnion(a, b);
+			case PAR_INTERSECT: return avlIntersect(a, b);
+			default: return avlDifference(a, b);
+		}
+	}
+
+	struct node *left, *right;
+	struct node *dup = avlSplit(a, b->data, &left, &right);
+
+	struct parTask task = {op, left, b->left};
+	forkTask(w, &task);
+	right = setOp(w, op, right, b->right);
+	joinTask(w, &task);
+	left = task.ret;
+
+	if(op == PAR_UNION || (op == PAR_INTERSECT && dup != NULL)){
+		free(dup);
+		return avlJoinMid(left, b, right);
+	}
+
+	free(dup);
+	free(b);
+	return avlJoin(left, right);
+}
+
+static struct node *filter(struct parWorker *w, struct node *tree){
+	if(tree == NULL) return NULL;
+
+	struct node *left, *right;
+	if(size(tree) > AVL_PAR_CUTOFF){
+		struct parTask task = {PAR_FILTER, tree->left};
+		forkTask(w, &task);
+		right = filter(w, tree->right);
+		joinTask(w, &task);
+		left = task.ret;
+	}else{
+		left = filter(w, tree->left);
+		right = filter(w, tree->right);
+	}
+
+	if(w->ctx->keep(tree->data, w->ctx->arg)) return avlJoinMid(left, tree, right);
+
+	free(tree);
+	return avlJoin(left, right);
+}
+
+/**	Halves are perfectly balanced, so the final join just links them
+**/
+static struct node *build(struct parWorker *w, const data_t *keys, size_t n){
+	if(n <= AVL_PAR_CUTOFF) return avlBuildSorted(keys, n);
+
+	size_t mid = n / 2;
+	struct node *root = avlBuildSorted(keys + mid, 1);
+
+	struct parTask task = {PAR_BUILD, NULL, NULL, keys, mid};
+	forkTask(w, &task);
+	struct node *right = build(w, keys + mid + 1, n - mid - 1);
+	joinTask(w, &task);
+	struct node *left = task.ret;
+
+	if(root == NULL || left == NULL || right == NULL){
+		free(root);
+		destroy(&left);
+		destroy(&right);
+		return NULL;
+	}
+
+	return avlJoinMid(left, root, right);
+}
+
+static void runTask(struct parWorker *w, struct parTask *task){
+	switch(task->op){
+		case PAR_FILTER:
+			task->ret = filter(w, task->a);
+		break;
+		case PAR_BUILD:
+			task->ret = build(w, task->keys, task->n);
+		break;
+		default:
+			task->ret = setOp(w, task->op, task->a, task->b);
+	}
+
+	// Owner may return and drop task as soon as it is done
+	int stolen = task->stolen;
+	atomic_store(&task->done, 1);
+	if(stolen) wake(w->ctx);
+}
+
+/**	Start threads - 1 workers, run task on this thread as worker 0, then
+	stop and join them. Workers that fail to start just leave fewer thieves.
+	Without memory for the pool it all runs on this thread.
+**/
+static struct node *runPool(struct parCtx *ctx, int threads, struct parTask *task){
+	struct parWorker single;
+	ctx->workers = (threads > 1) ? malloc(threads * sizeof(*ctx->workers)) : NULL;
+	if(ctx->workers == NULL){
+		ctx->workers = &single;
+		threads = 1;
+	}
+	ctx->count = threads;
+	atomic_init(&ctx->stop, 0);
+	atomic_init(&ctx->pending, 0);
+	atomic_init(&ctx->sleeping, 0);
+	pthread_mutex_init(&ctx->idleLock, NULL);
+	pthread_cond_init(&ctx->idle, NULL);
+
+	for(int i = 0;i < threads;i++){
+		ctx->workers[i].ctx = ctx;
+		ctx->workers[i].seed = i * 7919 + 1;
+		ctx->workers[i].head = ctx->workers[i].tail = 0;
+		pthread_mutex_init(&ctx->workers[i].lock, NULL);
+	}
+
+	int started[threads];
+	started[0] = 0;
+	for(int i = 1;i < threads;i++){
+		started[i] = !pthread_create(&ctx->workers[i].tid, NULL, workerThread, ctx->workers + i);
+	}
+
+	runTask(ctx->workers, task);
+
+	pthread_mutex_lock(&ctx->idleLock);
+	atomic_store(&ctx->stop, 1);
+	pthread_cond_broadcast(&ctx->idle);
+	pthread_mutex_unlock(&ctx->idleLock);
+	for(int i = 1;i < threads;i++){
+		if(started[i]) pthread_join(ctx->workers[i].tid, NULL);
+	}
+	for(int i = 0;i < threads;i++) pthread_mutex_destroy(&ctx->workers[i].lock);
+	pthread_mutex_destroy(&ctx->idleLock);
+	pthread_cond_destroy(&ctx->idle);
+	if(ctx->workers != &single) free(ctx->workers);
+
+	return task->ret;
+}
+
+struct node *avlParUnion(struct node *a, struct node *b, int threads){
+	struct parCtx ctx = {0};
+	struct parTask task = {PAR_UNION, a, b};
+	return runPool(&ctx, threads, &task);
+}
+struct node *avlParIntersect(struct node *a, struct node *b, int threads){
+	struct parCtx ctx = {0};
+	struct parTask task = {PAR_INTERSECT, a, b};
+	return runPool(&ctx, threads, &task);
+}
+struct node *avlParDifference(struct node *a, struct node *b, int threads){
+	struct parCtx ctx = {0};
+	struct parTask task = {PAR_DIFFERENCE, a, b};
+	return runPool(&ctx, threads, &task);
+}
+
+struct node *avlParFilter(struct node *tree, int (*keep)(data_t, void *), void *arg, int threads){
+	if(keep == NULL) return tree;
+
+	struct parCtx ctx = {0};
+	ctx.keep = keep;
+	ctx.arg = arg;
+	struct parTask task = {PAR_FILTER, tree};
+	return runPool(&ctx, threads, &task);
+}
+
+struct node *avlParBuildSorted(const data_t *keys, size_t n, int threads){
+	if(keys == NULL || n == 0) return NULL;
+
+	// Keys must be strictly increasing, chunks only check themselves
+	for(size_t i = 1;i < n;i++){
+		if(keys[i-1] >= keys[i]) return NULL;
+	}
+
+	struct parCtx ctx = {0};
+	struct parTask task = {PAR_BUILD, NULL, NULL, keys, n};
+	return runPool(&ctx, threads, &task);
+}
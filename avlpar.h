@@ -0,0 +1,46 @@
+/*
+	avlpar.h -- Multi-threaded fork-join operations on the AVL tree
+
+	Copyright (C) 2020 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#ifndef AVLPAR_H_
+#define AVLPAR_H_
+
+#include"avl.h"
+
+// Subtrees (or key ranges) smaller than this are handled by one thread
+#ifndef AVL_PAR_CUTOFF
+#define AVL_PAR_CUTOFF 16384
+#endif
+
+/**	Parallel variants of the join based operations. Each call starts a pool
+	of the given number of threads (counting the caller), each with its own
+	deque of forks. Recursive halves larger than the cutoff are pushed there
+	and run by whichever worker gets to them first, the owner or an idle
+	thief. Trees must be malloc'd (not pool) trees, since dropped nodes are
+	freed from several threads at once.
+**/
+struct node *avlParUnion(struct node *a, struct node *b, int threads);
+struct node *avlParIntersect(struct node *a, struct node *b, int threads);
+struct node *avlParDifference(struct node *a, struct node *b, int threads);
+
+// Keep only items where keep returns non-zero, freeing the rest
+struct node *avlParFilter(struct node *, int (*keep)(data_t, void *), void *arg, int threads);
+
+// Return new tree built from strictly increasing keys, NULL on failure
+struct node *avlParBuildSorted(const data_t *keys, size_t n, int threads);
+
+#endif
@@ -0,0 +1,232 @@
+/*
+	bst-bench.c -- Lookup benchmarks for the binary search tree
+
+	Copyright (C) 2019 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+#include<time.h>
+#include"bst.h"
+#include"avlgen.h"
+
+// AVL baseline. avl.h can't be linked next to bst.c (same names), so use the generator
+AVL_DEFINE(intAvl, int, char, AVL_CMP_NUM)
+
+#if defined(BST_SPLAY)
+#define MODE "splay"
+#define FIND(tree, data) find(&(tree), data)
+#elif defined(BST_TREAP)
+#define MODE "treap"
+#define FIND(tree, data) find(tree, data)
+#elif defined(BST_SCAPEGOAT)
+#define MODE "scapegoat"
+#define FIND(tree, data) find(tree, data)
+#else
+#define MODE "plain"
+#define FIND(tree, data) find(tree, data)
+#endif
+
+static double now(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void shuffle(int *arr, size_t n){
+	for(size_t i = n-1;i > 0;i--){
+		size_t j = rand() % (i+1);
+		int tmp = arr[i];
+		arr[i] = arr[j];
+		arr[j] = tmp;
+	}
+}
+
+/**	Fill out with n ranks in [0, N) where rank k has weight 1/(k+1)^s
+**/
+static int zipfRanks(size_t *out, size_t n, size_t N, double s){
+	double *cdf = malloc(N * sizeof(*cdf));
+	if(cdf == NULL) return -1;
+
+	double sum = 0;
+	for(size_t k = 0;k < N;k++){
+		sum += 1.0 / pow(k + 1, s);
+		cdf[k] = sum;
+	}
+
+	double u;
+	size_t lo, hi, mid;
+	for(size_t i = 0;i < n;i++){
+		u = sum * (rand() / (RAND_MAX + 1.0));
+		lo = 0;
+		hi = N-1;
+		while(lo < hi){
+			mid = (lo + hi) / 2;
+			if(cdf[mid] < u) lo = mid + 1;
+			else hi = mid;
+		}
+		out[i] = lo;
+	}
+
+	free(cdf);
+	return 0;
+}
+
+/**	Random inserts, then uniform, Zipf and sequential lookups, then inserts
+	in increasing order. AVL runs the same steps for reference.
+**/
+void benchLookup(const int *keys, size_t N, double s){
+	const size_t lookups = 4 * N;
+	int *order = malloc(lookups * sizeof(*order));
+	size_t *ranks = malloc(lookups * sizeof(*ranks));
+	if(order == NULL || ranks == NULL){
+		printf("Failed to allocate lookups\n");
+		free(order);
+		free(ranks);
+		return;
+	}
+
+	Node *tree = NULL;
+	struct intAvl avl = {NULL};
+	double start = now();
+	for(size_t i = 0;i < N;i++) insert(&tree, keys[i]);
+	printf("%-10s insert: %8.2f Minserts/s\n", MODE, N / (now() - start) / 1e6);
+	start = now();
+	for(size_t i = 0;i < N;i++) intAvl_insert(&avl, keys[i], 0);
+	printf("%-10s insert: %8.2f Minserts/s\n", "avl", N / (now() - start) / 1e6);
+
+	const char *names[] = {"uniform", "zipf", "sequential"};
+	for(int w = 0;w < 3;w++){
+		if(w == 0){
+			for(size_t i = 0;i < lookups;i++) order[i] = keys[rand() % N];
+		}else if(w == 1){
+			if(zipfRanks(ranks, lookups, N, s)){
+				printf("Failed to allocate zipf table\n");
+				continue;
+			}
+			// Hot keys are spread over the key space, not clustered at one end
+			for(size_t i = 0;i < lookups;i++) order[i] = keys[ranks[i]];
+		}else{
+			for(size_t i = 0;i < lookups;i++) order[i] = 2*(i % N);
+		}
+
+		size_t hits = 0;
+		start = now();
+		for(size_t i = 0;i < lookups;i++) hits += FIND(tree, order[i]);
+		printf("%-10s %-10s: %6.2f Mlookups/s (%lu hits)\n", MODE, names[w], lookups / (now() - start) / 1e6, hits);
+
+		hits = 0;
+		start = now();
+		for(size_t i = 0;i < lookups;i++) hits += (intAvl_find(&avl, order[i]) != NULL);
+		printf("%-10s %-10s: %6.2f Mlookups/s (%lu hits)\n", "avl", names[w], lookups / (now() - start) / 1e6, hits);
+	}
+
+	destroy(&tree);
+	intAvl_destroy(&avl);
+
+	// Increasing keys, like IDs. Quadratic for the plain tree, so keep it small there
+	size_t sorted = N;
+#if !defined(BST_SPLAY) && !defined(BST_TREAP) && !defined(BST_SCAPEGOAT)
+	if(sorted > 20000) sorted = 20000;
+#endif
+	start = now();
+	for(size_t i = 0;i < sorted;i++) insert(&tree, i);
+	printf("%-10s sorted insert: %8.3f Minserts/s (%lu keys, height %u)\n", MODE, sorted / (now() - start) / 1e6,
+		sorted, maxHeight(tree));
+	start = now();
+	for(size_t i = 0;i < sorted;i++) intAvl_insert(&avl, i, 0);
+	printf("%-10s sorted insert: %8.3f Minserts/s (%lu keys)\n", "avl", sorted / (now() - start) / 1e6, sorted);
+
+	destroy(&tree);
+	intAvl_destroy(&avl);
+	free(order);
+	free(ranks);
+}
+
+/**	Remove every key in random order, from a tree built in random order
+**/
+void benchRemove(const int *keys, size_t N){
+	int *order = malloc(N * sizeof(*order));
+	if(order == NULL){
+		printf("Failed to allocate keys\n");
+		return;
+	}
+	memcpy(order, keys, N * sizeof(*order));
+	shuffle(order, N);
+
+	Node *tree = NULL;
+	struct intAvl avl = {NULL};
+	for(size_t i = 0;i < N;i++) insert(&tree, keys[i]);
+	for(size_t i = 0;i < N;i++) intAvl_insert(&avl, keys[i], 0);
+
+	size_t fails = 0;
+	double start = now();
+	for(size_t i = 0;i < N;i++) fails += (removeNode(&tree, order[i]) != 0);
+	printf("%-10s remove: %8.2f Mremoves/s (%lu failed)\n", MODE, N / (now() - start) / 1e6, fails);
+
+	fails = 0;
+	start = now();
+	for(size_t i = 0;i < N;i++) fails += (intAvl_remove(&avl, order[i], NULL) != 0);
+	printf("%-10s remove: %8.2f Mremoves/s (%lu failed)\n", "avl", N / (now() - start) / 1e6, fails);
+
+	destroy(&tree);
+	intAvl_destroy(&avl);
+	free(order);
+}
+
+int main(int argc, char *argv[]){
+	srand(time(0));
+
+	const char *mode = "lookup";
+	size_t N = 1000000;
+	double s = 0.99;
+	if(argc >= 2){
+		mode = argv[1];
+	}
+	if(argc >= 3){
+		N = strtol(argv[2], NULL, 10);
+	}
+	if(argc >= 4){
+		s = strtod(argv[3], NULL);
+	}
+
+	printf("Benchmarking %s on %s tree with %lu keys, %lu byte nodes..\n", mode, MODE, N, sizeof(Node));
+
+	int *keys = malloc(N * sizeof(*keys));
+	if(keys == NULL){
+		printf("Failed to allocate keys\n");
+		return 1;
+	}
+
+	// Keys 0, 2, 4.. in random order
+	for(size_t i = 0;i < N;i++) keys[i] = 2*i;
+	shuffle(keys, N);
+
+	if(!strcmp(mode, "lookup")){
+		printf("Zipf s = %.2f\n", s);
+		benchLookup(keys, N, s);
+	}else if(!strcmp(mode, "remove")){
+		benchRemove(keys, N);
+	}else{
+		printf("Unknown mode '%s'. Modes: lookup remove\n", mode);
+	}
+
+	free(keys);
+
+	return 0;
+}
@@ -0,0 +1,221 @@
+/*
+	bst-test.c -- Random operations on the binary search tree, checked
+		against a membership table
+
+	Copyright (C) 2019 Christopher Skane
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	Full license at https://www.gnu.org/licenses/old-licenses/gpl-2.0.en.html
+*/
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+#include<time.h>
+#include"bst.h"
+
+/**	Build once per mode, same as bst.c: plain, then with -DBST_SPLAY,
+	-DBST_TREAP and -DBST_SCAPEGOAT.
+**/
+#if defined(BST_SPLAY)
+#define MODE "splay"
+#define FIND(tree, data) find(&(tree), data)
+#elif defined(BST_TREAP)
+#define MODE "treap"
+#define FIND(tree, data) find(tree, data)
+#elif defined(BST_SCAPEGOAT)
+#define MODE "scapegoat"
+#define FIND(tree, data) find(tree, data)
+#else
+#define MODE "plain"
+#define FIND(tree, data) find(tree, data)
+#endif
+
+/**	Checks every key is in (lo, hi), sizes add up, and for treaps that no
+	child outranks its parent. Returns number of nodes, -1 if bad.
+**/
+long checkTree(const struct node *root, long lo, long hi){
+	if(root == NULL) return 0;
+
+	if(root->data <= lo || root->data >= hi){
+		printf("Node %d out of order, should be in (%ld, %ld)\n", root->data, lo, hi);
+		return -1;
+	}
+#ifdef BST_TREAP
+	if((root->left != NULL && root->left->priority > root->priority)
+		|| (root->right != NULL && root->right->priority > root->priority)){
+		printf("Node %d has a child of higher priority\n", root->data);
+		return -1;
+	}
+#endif
+
+	long left = checkTree(root->left, lo, root->data);
+	long right = checkTree(root->right, root->data, hi);
+	if(left < 0 || right < 0) return -1;
+
+	if(root->size != 1 + left + right){
+		printf("Node %d has size %u, counted %ld\n", root->data, root->size, 1 + left + right);
+		return -1;
+	}
+
+	return 1 + left + right;
+}
+
+/**	Treaps are O(log n) deep with high probability; 4 log2(n) is far past
+	any height they reach in practice. Removes never deepen a scapegoat tree,
+	so it stays within log_{1/alpha} of the largest size it has had, plus 1.
+	Other modes have no bound.
+**/
+int checkHeight(const struct node *root, uint32_t peak){
+	uint32_t height = maxHeight(root), n = size(root), bound = UINT32_MAX;
+#if defined(BST_TREAP)
+	bound = 4 * log2(n + 1) + 4;
+#elif defined(BST_SCAPEGOAT)
+	bound = log(peak + 1) / log(1 / BST_ALPHA) + 1;
+#endif
+	(void)n;
+	(void)peak;
+
+	if(height == UINT32_MAX || height > bound){
+		printf("Height %u of %u nodes is over %u\n", height, n, bound);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**	Structure, size and height together, against the expected count
+**/
+int checkAll(const struct node *root, uint32_t count, uint32_t peak){
+	long n = checkTree(root, -1, INT32_MAX);
+	if(n < 0) return -1;
+	if(n != count || size(root) != count){
+		printf("Tree has %ld nodes, size %u, expected %u\n", n, size(root), count);
+		return -1;
+	}
+
+	return checkHeight(root, peak);
+}
+
+/**	Mixed inserts, removes and finds over keys [0, 2N), each checked
+	against in[]. Whole tree is checked every N/4 operations.
+**/
+int checkRandom(Node **tree, char *in, uint32_t N, uint32_t *count, uint32_t *peak){
+	const uint32_t M = 2*N, ops = 8*N;
+	int ret;
+	for(uint32_t i = 0;i < ops;i++){
+		int key = rand() % M;
+		switch(rand() % 3){
+		case 0:
+			ret = insert(tree, key);
+			if((ret == 0) == in[key]){
+				printf("Insert of %d returned %d, key was %s\n", key, ret, (in[key]) ? "present" : "missing");
+				return -1;
+			}
+			if(!in[key]) *count += 1;
+			in[key] = 1;
+			break;
+		case 1:
+			ret = removeNode(tree, key);
+			if((ret == 0) != in[key]){
+				printf("Remove of %d returned %d, key was %s\n", key, ret, (in[key]) ? "present" : "missing");
+				return -1;
+			}
+			if(in[key]) *count -= 1;
+			in[key] = 0;
+			break;
+		default:
+			if(!FIND(*tree, key) != !in[key]){
+				printf("Find of %d disagrees, key is %s\n", key, (in[key]) ? "present" : "missing");
+				return -1;
+			}
+		}
+		if(*count > *peak) *peak = *count;
+
+		if((i + 1) % (N/4 + 1) == 0 && checkAll(*tree, *count, *peak)){
+			printf("Tree is bad after %u operations\n", i + 1);
+			return -1;
+		}
+	}
+
+	for(uint32_t key = 0;key < M;key++){
+		if(!FIND(*tree, key) != !in[key]){
+			printf("Find of %u disagrees, key is %s\n", key, (in[key]) ? "present" : "missing");
+			return -1;
+		}
+	}
+
+	return checkAll(*tree, *count, *peak);
+}
+
+int main(int argc, char *argv[]){
+	srand(time(0));
+
+	uint32_t N = 20000;
+	if(argc == 2){
+		N = strtol(argv[1], NULL, 10);
+	}
+	if(N == 0) N = 1;
+
+	char *in = calloc(2*N, sizeof(*in));
+	if(in == NULL){
+		printf("Failed to allocate membership table\n");
+		return 1;
+	}
+
+	printf("Checking %s tree with %u keys..\n", MODE, N);
+
+	Node *tree = NULL;
+	uint32_t count = 0, peak = 0;
+	int bad = checkRandom(&tree, in, N, &count, &peak);
+	printf("Random operations %s\n", (bad) ? "FAILED" : "passed");
+
+	// Empty it out in increasing order
+	for(uint32_t key = 0;key < 2*N && !bad;key++){
+		if((removeNode(&tree, key) == 0) != in[key]){
+			printf("Remove of %u disagrees, key was %s\n", key, (in[key]) ? "present" : "missing");
+			bad = 1;
+		}
+		in[key] = 0;
+	}
+	if(!bad && tree != NULL){
+		printf("Tree not empty after removing everything\n");
+		bad = 1;
+	}
+	destroy(&tree);
+
+	// Sorted inserts, the worst order for the plain tree, so keep it small there
+	uint32_t sorted = N;
+#if !defined(BST_SPLAY) && !defined(BST_TREAP) && !defined(BST_SCAPEGOAT)
+	if(sorted > 2000) sorted = 2000;
+#endif
+	for(uint32_t key = 0;key < sorted && !bad;key++) bad = insert(&tree, key);
+	if(!bad) bad = checkAll(tree, sorted, sorted);
+#ifdef BST_TREAP
+	// Split in the middle and merge back
+	Node *left, *right;
+	if(!bad){
+		long mid = sorted / 2;
+		split(tree, mid, &left, &right);
+		bad = (checkTree(left, -1, mid) != mid || checkTree(right, mid - 1, sorted) != sorted - mid);
+		tree = merge(left, right);
+		if(!bad) bad = checkAll(tree, sorted, sorted);
+	}
+#endif
+	printf("Sorted inserts %s\n", (bad) ? "FAILED" : "passed");
+	destroy(&tree);
+
+	free(in);
+
+	return bad;
+}
@@ -18,207 +18,473 @@
 
 #include"bst.h"
 
-// This may not actually return parent, but node instead. Check
-struct node **getParent(struct node *tree, int data){
-	if(tree != NULL){
+static inline uint32_t nodeSize(const struct node *tree){
+	return (tree != NULL) ? tree->size : 0;
+}
+
+// Decrement all sizes up to, but not including node with data
+void decrementChain(struct node *root, int data){
+	while(root != NULL && root->data != data){
+		root->size--;
+		root = (root->data > data) ? root->left : root->right;
+	}
+}
+
+#if defined(BST_SPLAY)
+/**	Top-down splay (Sleator & Tarjan). Nodes passed on the way down are hung
+	on a left tree (smaller) and right tree (larger), which are attached under
+	the last node reached once it becomes root. Sizes of nodes on the left
+	tree's right spine and right tree's left spine are only known at the end,
+	so they are set in a second walk down those spines.
+**/
+static struct node *splay(struct node *tree, int data){
+	if(tree == NULL) return NULL;
+
+	struct node head = {0};
+	struct node *l = &head, *r = &head, *y;
+	uint32_t lSize = 0, rSize = 0;
+
+	for(;;){
 		if(tree->data > data){
-			if(tree->left != NULL){
-				if(tree->left->data == data){
-					//printf("0x%X has data child 0x%X\n", tree, tree->left);
-					return &(tree->left);
-				}else return getParent(tree->left, data);
+			if(tree->left == NULL) break;
+			if(tree->left->data > data){
+				// Rotate right
+				y = tree->left;
+				tree->left = y->right;
+				y->right = tree;
+				tree->size = nodeSize(tree->left) + nodeSize(tree->right) + 1;
+				tree = y;
+				if(tree->left == NULL) break;
 			}
+
+			// Link right
+			r->left = tree;
+			r = tree;
+			tree = tree->left;
+			rSize += 1 + nodeSize(r->right);
 		}else if(tree->data < data){
-			if(tree->right != NULL){
-				if(tree->right->data == data){
-					//printf("0x%X has data child 0x%X\n", tree, tree->right);
-					return &(tree->right);
-				}else return getParent(tree->right, data);
+			if(tree->right == NULL) break;
+			if(tree->right->data < data){
+				// Rotate left
+				y = tree->right;
+				tree->right = y->left;
+				y->left = tree;
+				tree->size = nodeSize(tree->left) + nodeSize(tree->right) + 1;
+				tree = y;
+				if(tree->right == NULL) break;
 			}
-		}
+
+			// Link left
+			l->right = tree;
+			l = tree;
+			tree = tree->right;
+			lSize += 1 + nodeSize(l->left);
+		}else break;
 	}
 
-	return NULL; // Not found (false)
-}
+	lSize += nodeSize(tree->left);
+	rSize += nodeSize(tree->right);
+	tree->size = lSize + rSize + 1;
 
-// Decrement all sizes up to, but not including node with data
-void decrementChain(struct node *root, int data){
-	if(root != NULL){
-		if(root->data == data){
-			return; // Found data
-		}
-		else if(root->data > data){
-			root->size--;
-			decrementChain(root->left, data);
-		}else if(root->data < data){
-			root->size--;
-			decrementChain(root->right, data);
-		}
+	l->right = NULL;
+	r->left = NULL;
+	for(y = head.right;y != NULL;y = y->right){
+		y->size = lSize;
+		lSize -= 1 + nodeSize(y->left);
 	}
+	for(y = head.left;y != NULL;y = y->left){
+		y->size = rSize;
+		rSize -= 1 + nodeSize(y->right);
+	}
+
+	// Assemble
+	l->right = tree->left;
+	r->left = tree->right;
+	tree->left = head.right;
+	tree->right = head.left;
+
+	return tree;
 }
 
 int insert(struct node **tree, int data){
-	if(*tree == NULL){
-		//printf("Inserting %d\n", data);
-		(*tree) = malloc(sizeof(Node));// Onf at end of branch, insert leaf
-		(*tree)->data = data;
-		(*tree)->size = 1;
-		(*tree)->left = NULL;
-		(*tree)->right = NULL;
+	struct node *root = splay(*tree, data);
+	if(root != NULL && root->data == data){
+		*tree = root;
+		return -1; // If data already exists
+	}
 
-		return 0;
+	struct node *leaf = malloc(sizeof(Node));
+	if(leaf == NULL){
+		*tree = root;
+		return -1;
+	}
+	leaf->data = data;
+	leaf->left = NULL;
+	leaf->right = NULL;
+
+	// Old root goes under the new one, split by data
+	if(root != NULL && root->data > data){
+		leaf->left = root->left;
+		leaf->right = root;
+		root->left = NULL;
+		root->size = nodeSize(root->right) + 1;
+	}else if(root != NULL){
+		leaf->right = root->right;
+		leaf->left = root;
+		root->right = NULL;
+		root->size = nodeSize(root->left) + 1;
+	}
+	leaf->size = nodeSize(leaf->left) + nodeSize(leaf->right) + 1;
+	*tree = leaf;
+
+	return 0;
+}
+
+int removeNode(struct node **tree, int data){
+	struct node *root = splay(*tree, data);
+	*tree = root;
+	if(root == NULL || root->data != data) return -1;
+
+	if(root->left == NULL){
+		*tree = root->right;
 	}else{
-		char ret = 0;
-		if((*tree)->data == data){
-			return -1; // If data already exists
-		}
-		else if((*tree)->data > data){
-			ret = insert(&((*tree)->left), data); // Recurse to add
-			if(!ret) (*tree)->size++; // Increment only if data did not exist
-			return ret;
-		}else if((*tree)->data < data){
-			ret = insert(&((*tree)->right), data);
-			if(!ret) (*tree)->size++;
-			return ret;
-		}
+		// Max of left subtree comes up with no right child
+		*tree = splay(root->left, data);
+		(*tree)->right = root->right;
+		(*tree)->size += nodeSize(root->right);
+	}
+
+	free(root);
+	return 0;
+}
+
+// Returns non-zero if data is in tree, zero otherwise. Last node reached becomes root
+int find(struct node **tree, int data){
+	*tree = splay(*tree, data);
+
+	return (*tree != NULL && (*tree)->data == data);
+}
+
+#elif defined(BST_TREAP)
+// Xorshift, so priorities don't disturb the caller's rand() sequence
+static uint32_t prioState = 2463534242u;
+static inline uint32_t nextPriority(void){
+	prioState ^= prioState << 13;
+	prioState ^= prioState >> 17;
+	prioState ^= prioState << 5;
+	return prioState;
+}
+
+/**	Split and merge recurse once per level, which is O(log n) expected in a
+	treap no matter the insert order.
+**/
+void split(struct node *tree, int data, struct node **left, struct node **right){
+	if(tree == NULL){
+		*left = NULL;
+		*right = NULL;
+		return;
 	}
 
-	return -1;
+	if(tree->data < data){
+		split(tree->right, data, &tree->right, right);
+		*left = tree;
+	}else{
+		split(tree->left, data, left, &tree->left);
+		*right = tree;
+	}
+	tree->size = nodeSize(tree->left) + nodeSize(tree->right) + 1;
 }
 
+struct node *merge(struct node *left, struct node *right){
+	if(left == NULL) return right;
+	if(right == NULL) return left;
+
+	if(left->priority > right->priority){
+		left->right = merge(left->right, right);
+		left->size = nodeSize(left->left) + nodeSize(left->right) + 1;
+		return left;
+	}else{
+		right->left = merge(left, right->left);
+		right->size = nodeSize(right->left) + nodeSize(right->right) + 1;
+		return right;
+	}
+}
+
+/**	Same descent as the plain tree, except the new node stops above the first
+	node with a lower priority, and takes that subtree split in two.
+**/
+int insert(struct node **tree, int data){
+	if(find(*tree, data)) return -1; // If data already exists
+
+	struct node *leaf = malloc(sizeof(Node));
+	if(leaf == NULL) return -1;
+	leaf->data = data;
+	leaf->priority = nextPriority();
+
+	while(*tree != NULL && (*tree)->priority >= leaf->priority){
+		(*tree)->size++;
+		tree = ((*tree)->data > data) ? &((*tree)->left) : &((*tree)->right);
+	}
+
+	split(*tree, data, &leaf->left, &leaf->right);
+	leaf->size = nodeSize(leaf->left) + nodeSize(leaf->right) + 1;
+	*tree = leaf;
+
+	return 0;
+}
+
+// Children of the removed node are merged into its place
 int removeNode(struct node **tree, int data){
-	if((*tree) == NULL) return -1;
-
-	if((*tree)->data == data){
-		// If at the node to remove, get min of right or max of left for root
-		// Maybe have it choose larger side to take from
-		if((*tree)->right != NULL){
-			// Get min value from right subtree to replace root
-			(*tree)->data = min((*tree)->right);
-
-			// Either short replace and simply move entire subtree up, or standard.
-			if((*tree)->data == (*tree)->right->data){
-				struct node *old = (*tree)->right;
-				(*tree)->right = (*tree)->right->right; // Move subtree up
-
-				free(old);
-				old = NULL;
-			}else{
-				// Get the node who's value was copied
-				struct node **replacement = getParent((*tree)->right, (*tree)->data);
-				if(replacement == NULL){
-					printf("Remove failed\n");
-					return -1;
-				}
-
-				decrementChain((*tree)->right, (*tree)->data);
-				struct node *old = (*replacement);
-				(*replacement) = (*replacement)->right; // Replace moved node with subtree
-				free(old);
-			}
+	if(!find(*tree, data)) return -1;
 
-			(*tree)->size--;
-		}else if((*tree)->left != NULL){
-			// Get max value from left subtree to replace root
-			(*tree)->data = max((*tree)->left);
-
-			// Same replace decision as above, with left subtree instead
-			if((*tree)->data == (*tree)->left->data){
-				struct node *old = (*tree)->left;
-				(*tree)->left = (*tree)->left->left; // Move subtree up
-
-				free(old);
-				old = NULL;
-			}else{
-				struct node **replacement = getParent((*tree)->left, (*tree)->data);
-				if(replacement == NULL){
-					printf("Remove failed\n");
-					return -1;
-				}
-
-				decrementChain((*tree)->left, (*tree)->data);
-				struct node *old = (*replacement);
-				(*replacement) = (*replacement)->left; // Replace moved node with subtree
-				free(old);
-			}
+	while((*tree)->data != data){
+		(*tree)->size--;
+		tree = ((*tree)->data > data) ? &((*tree)->left) : &((*tree)->right);
+	}
+
+	struct node *old = *tree;
+	*tree = merge(old->left, old->right);
+	free(old);
 
-			(*tree)->size--;
+	return 0;
+}
+
+#elif defined(BST_SCAPEGOAT)
+#define SCAPEGOAT_STACK 128		// Path bound for alpha up to 0.8, log_{1.25}(2^32) is 100
+
+// Return non-zero if depth is more than log_{1/alpha}(n)
+static inline int tooDeep(uint32_t depth, uint32_t n){
+	double limit = 1;
+	while(depth-- > 0){
+		limit /= BST_ALPHA;
+		if(limit > n) return 1;
+	}
+
+	return 0;
+}
+
+/**	Rotate left children up, appending each node that has none to a list
+	linked through right. Returns smallest node of the list
+**/
+static struct node *flatten(struct node *tree){
+	struct node head = {0}, *tail = &head, *next;
+	while(tree != NULL){
+		if(tree->left != NULL){
+			next = tree->left;
+			tree->left = next->right;
+			next->right = tree;
+			tree = next;
 		}else{
-			// Node is leaf, simply delete
-			free(*tree);
-			(*tree) = NULL;
+			tail->right = tree;
+			tail = tree;
+			tree = tree->right;
 		}
+	}
 
-		return 0;
+	tail->right = NULL;
+	return head.right;
+}
+
+// Take n nodes off the front of list, as a perfectly balanced tree
+static struct node *buildBalanced(struct node **list, uint32_t n){
+	if(n == 0) return NULL;
+
+	struct node *left = buildBalanced(list, (n-1)/2);
+	struct node *root = *list;
+	*list = root->right;
+
+	root->left = left;
+	root->right = buildBalanced(list, n - 1 - (n-1)/2);
+	root->size = n;
+
+	return root;
+}
+
+/**	Plain insert, remembering the path. If the new leaf is deeper than
+	log_{1/alpha}(n), the lowest ancestor with a child holding more than
+	alpha of its items (the scapegoat) is rebuilt in place. One always
+	exists on such a path.
+**/
+int insert(struct node **tree, int data){
+	struct node **path[SCAPEGOAT_STACK];
+	uint32_t depth = 0;
+
+	struct node **cur = tree;
+	while(*cur != NULL){
+		if((*cur)->data == data) return -1; // If data already exists
+		if(depth == SCAPEGOAT_STACK) return -1;
+
+		path[depth++] = cur;
+		cur = ((*cur)->data > data) ? &((*cur)->left) : &((*cur)->right);
 	}
-	else if((*tree)->data > data){ // Traversal conditions
-		int ret = removeNode(&((*tree)->left), data);
-		if(!ret) (*tree)->size--;
-		return ret;
-	}else if((*tree)->data < data){
-		int ret = removeNode(&((*tree)->right), data);
-		if(!ret) (*tree)->size--;
-		return ret;
+
+	(*cur) = malloc(sizeof(Node)); // At end of branch, insert leaf
+	if(*cur == NULL) return -1;
+	(*cur)->data = data;
+	(*cur)->size = 1;
+	(*cur)->left = NULL;
+	(*cur)->right = NULL;
+
+	for(uint32_t i = 0;i < depth;i++) (*path[i])->size++;
+
+	if(tooDeep(depth, (*tree)->size)){
+		struct node *child = *cur, *list;
+		uint32_t n;
+		while(depth-- > 0){
+			n = (*path[depth])->size;
+			if(child->size > BST_ALPHA * n){
+				list = flatten(*path[depth]);
+				*path[depth] = buildBalanced(&list, n);
+				break;
+			}
+			child = *path[depth];
+		}
 	}
 
-	return -1;
+	return 0;
 }
 
-// Returns non-zero if data is in tree, zero otherwise
-int find(const struct node *tree, int data){
-	if(tree != NULL){
-		if(tree->data == data){
-			return 1; // Found data
+#else
+// Sizes are bumped on the way down, and put back if data already exists
+int insert(struct node **tree, int data){
+	struct node **cur = tree;
+	while(*cur != NULL){
+		if((*cur)->data == data){
+			decrementChain(*tree, data);
+			return -1; // If data already exists
 		}
-		else if(tree->data > data) return find(tree->left, data); // Recurse to add
-		else if(tree->data < data) return find(tree->right, data);
+
+		(*cur)->size++;
+		cur = ((*cur)->data > data) ? &((*cur)->left) : &((*cur)->right);
 	}
 
-	return 0;// Not found (false)
+	(*cur) = malloc(sizeof(Node)); // At end of branch, insert leaf
+	if(*cur == NULL){
+		decrementChain(*tree, data);
+		return -1;
+	}
+	(*cur)->data = data;
+	(*cur)->size = 1;
+	(*cur)->left = NULL;
+	(*cur)->right = NULL;
+
+	return 0;
 }
 
-uint32_t size(const struct node *tree){
-	if(tree != NULL){
-		int count = size(tree->left);
-		count++; // This node
-		count += size(tree->right);
+#endif
+
+#if !defined(BST_SPLAY) && !defined(BST_TREAP)
+/**	One descent, decrementing sizes on the way (put back if data is missing).
+	A node with two children takes the data of its successor, which is then
+	unlinked at the bottom of the same walk.
+**/
+int removeNode(struct node **tree, int data){
+	struct node **cur = tree;
+	while(*cur != NULL && (*cur)->data != data){
+		(*cur)->size--;
+		cur = ((*cur)->data > data) ? &((*cur)->left) : &((*cur)->right);
+	}
 
-		return count;
+	if(*cur == NULL){
+		// Not found, undo
+		for(struct node *fix = *tree;fix != NULL;fix = (fix->data > data) ? fix->left : fix->right){
+			fix->size++;
+		}
+		return -1;
+	}
+
+	struct node *old = *cur;
+	if(old->left == NULL){
+		*cur = old->right;
+	}else if(old->right == NULL){
+		*cur = old->left;
+	}else{
+		// Min of right subtree replaces data, its right subtree moves up
+		old->size--;
+		cur = &(old->right);
+		while((*cur)->left != NULL){
+			(*cur)->size--;
+			cur = &((*cur)->left);
+		}
+
+		struct node *succ = *cur;
+		old->data = succ->data;
+		*cur = succ->right;
+		old = succ;
 	}
 
+	free(old);
 	return 0;
 }
+#endif
 
+#ifndef BST_SPLAY
+// Returns non-zero if data is in tree, zero otherwise
+int find(const struct node *tree, int data){
+	while(tree != NULL){
+		if(tree->data > data) tree = tree->left;
+		else if(tree->data < data) tree = tree->right;
+		else return 1; // Found data
+	}
+
+	return 0; // Not found (false)
+}
+#endif
+
+// Size is kept in every node, so no need to count
+uint32_t size(const struct node *tree){
+	return nodeSize(tree);
+}
+
+/**	Depth first with an explicit stack, since an unbalanced tree can be as
+	deep as it is big. Only one child waits per level, so the stack holds at
+	most height + 1 entries. It starts small and doubles when full.
+**/
 uint32_t maxHeight(const struct node *root){
 	if(root == NULL){
 		return 0;
 	}
 
-	int left = 0;
-	if(root->left != NULL){
-		left = maxHeight(root->left) + 1;
-	}
+	struct heightEntry{
+		const struct node *node;
+		uint32_t depth;
+	} *stack = malloc(64 * sizeof(*stack)), *tmp;
+	if(stack == NULL) return UINT32_MAX;
+
+	uint32_t height = 0, depth, top = 0, cap = 64;
+	stack[top++] = (struct heightEntry){root, 0};
+	while(top > 0){
+		root = stack[--top].node;
+		depth = stack[top].depth;
+		if(depth > height) height = depth;
+
+		if(top + 2 > cap){
+			tmp = realloc(stack, 2 * cap * sizeof(*stack));
+			if(tmp == NULL){
+				free(stack);
+				return UINT32_MAX;
+			}
+			stack = tmp;
+			cap *= 2;
+		}
 
-	int right = 0;
-	if(root->right != NULL){
-		right = maxHeight(root->right) + 1;
+		if(root->left != NULL) stack[top++] = (struct heightEntry){root->left, depth + 1};
+		if(root->right != NULL) stack[top++] = (struct heightEntry){root->right, depth + 1};
 	}
 
-	if(left > right) return left;
-	else return right;
-
-	return 0;
+	free(stack);
+	return height;
 }
 
 int max(const struct node *tree){
 	if(tree == NULL) return 0;
-	if(tree->right == NULL) return tree->data;// If next node is null, max
-	return max(tree->right);
+	while(tree->right != NULL) tree = tree->right; // If next node is null, max
+	return tree->data;
 }
 int min(const struct node *tree){
 	if(tree == NULL) return 0;
-	if(tree->left == NULL) return tree->data;// If next node is null, min
-	return min(tree->left);
+	while(tree->left != NULL) tree = tree->left; // If next node is null, min
+	return tree->data;
 }
 
 void printTree(struct node *tree){
@@ -230,11 +496,22 @@ void printTree(struct node *tree){
 	}
 }
 
+/**	Rotates left children up until the current node has none, then frees it
+	and moves right. No recursion, so a tree shaped like a list is fine.
+**/
 void destroy(struct node **tree){
-	if((*tree) != NULL){
-		if((*tree)->left != NULL) destroy(&((*tree)->left));
-		if((*tree)->right != NULL) destroy(&((*tree)->right));
-		free(*tree);
-		*tree = NULL;
+	struct node *cur = *tree, *next;
+	while(cur != NULL){
+		if(cur->left != NULL){
+			next = cur->left;
+			cur->left = next->right;
+			next->right = cur;
+		}else{
+			next = cur->right;
+			free(cur);
+		}
+		cur = next;
 	}
+
+	*tree = NULL;
 }
@@ -23,9 +23,28 @@
 #include<stdlib.h>
 #include<stdint.h>
 
+/**	Balancing mode is picked at build time, behind the same functions:
+		BST_SPLAY	Top-down splay tree. find moves the node it reaches to the
+				root, so it takes the tree by reference
+		BST_TREAP	Treap. Each node gets a random priority and sits above
+				all lower priorities, for O(log n) expected depth in
+				any insert order. Adds split and merge
+		BST_SCAPEGOAT	Scapegoat tree. An insert deeper than log_{1/alpha}(n)
+				rebuilds the unbalanced subtree above it, found from
+				sizes alone, so nodes stay 24 bytes
+	Default is a plain unbalanced tree.
+**/
+
+#ifndef BST_ALPHA
+#define BST_ALPHA 0.7		// Scapegoat weight balance, in (0.5, 1)
+#endif
+
 typedef struct node{
 	int data;
 	uint32_t size;			// Size of subtree, including this node
+#ifdef BST_TREAP
+	uint32_t priority;		// Heap ordered, highest at root
+#endif
 	struct node *left;
 	struct node *right;
 } Node;
@@ -37,15 +56,28 @@ int insert(struct node **, int data);
 int removeNode(struct node **, int data);
 
 // Return non-zero if found, 0 otherwise
+#ifdef BST_SPLAY
+int find(struct node **, int data);
+#else
 int find(const struct node *, int data);
+#endif
+
+#ifdef BST_TREAP
+// Move items < data into left and the rest into right, consuming tree
+void split(struct node *, int data, struct node **left, struct node **right);
+
+// Join trees where all items of left are smaller than all items of right
+struct node *merge(struct node *left, struct node *right);
+#endif
 
 // Return max/min number
 int max(const struct node *);
 int min(const struct node *);
 
-// Get total number of items in tree
+// Get total number of items in tree (constant time)
 uint32_t size(const struct node *);
 
+// Get height of tree (edges on the longest path). UINT32_MAX if out of memory
 uint32_t maxHeight(const struct node *);
 
 // Prints whole tree (in-order)
@@ -0,0 +1,518 @@
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include<pthread.h>
+#ifdef __GLIBC__
+#include<malloc.h>
+#endif
+#include"btree.h"
+#include"btreedisk.h"
+#include"btreec.h"
+
+static double now(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**	Bytes malloc has handed out, counting large blocks it mmaps (glibc only)
+**/
+static size_t heap_bytes(void){
+#ifdef __GLIBC__
+	struct mallinfo2 mi = mallinfo2();
+	return mi.uordblks + mi.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+/**	Random lookups (half hits) one at a time vs through btree_find_batch
+**/
+void bench_batch(struct btree *bt, long *data, size_t size, size_t range){
+	const size_t lookups = 4000000;
+	long *keys = malloc(lookups * sizeof(*keys));
+	int *res = malloc(lookups * sizeof(*res));
+	if(keys == NULL || res == NULL){
+		printf("Failed to allocate lookups\n");
+		free(keys);
+		free(res);
+		return;
+	}
+	for(size_t i = 0;i < lookups;i++){
+		keys[i] = (rand() & 1) ? data[rand() % size] : rand() % range;
+	}
+
+	double start = now();
+	size_t hits = 0;
+	for(size_t i = 0;i < lookups;i++) hits += btree_find(bt, keys[i]);
+	double elapsed = now() - start;
+	printf("loop      : %6.2f Mlookups/s (%lu hits)\n", lookups / elapsed / 1e6, hits);
+
+	const size_t batches[] = {16, 64, 256, 1024};
+	for(size_t b = 0;b < sizeof(batches) / sizeof(*batches);b++){
+		start = now();
+		for(size_t i = 0;i < lookups;i += batches[b]){
+			size_t n = (lookups - i < batches[b]) ? lookups - i : batches[b];
+			btree_find_batch(bt, keys + i, n, res + i);
+		}
+		elapsed = now() - start;
+
+		size_t batch_hits = 0;
+		for(size_t i = 0;i < lookups;i++) batch_hits += (res[i] != 0);
+		printf("batch %4lu: %6.2f Mlookups/s (%lu hits)%s\n", batches[b], lookups / elapsed / 1e6, batch_hits,
+			(batch_hits != hits) ? " MISMATCH" : "");
+	}
+
+	free(keys);
+	free(res);
+}
+
+/**	Remove every key in random order, then reinsert and remove again with
+	a mix of hits and misses
+**/
+void bench_remove(struct btree *bt, long *data, size_t size){
+	for(size_t i = size-1;i > 0;i--){
+		size_t j = rand() % (i+1);
+		long tmp = data[i];
+		data[i] = data[j];
+		data[j] = tmp;
+	}
+
+	size_t fails = 0;
+	double start = now();
+	for(size_t i = 0;i < size;i++) fails += (btree_remove(bt, data[i]) != 0);
+	double elapsed = now() - start;
+	printf("remove    : %6.2f Mremoves/s (%lu failed, %s)\n", size / elapsed / 1e6, fails,
+		(bt->size == 0 && btree_check(bt) == 0) ? "empty" : "NOT EMPTY");
+
+	start = now();
+	for(size_t i = 0;i < size;i++) btree_insert(bt, data[i]);
+	elapsed = now() - start;
+	printf("reinsert  : %6.2f Minserts/s\n", size / elapsed / 1e6);
+
+	fails = 0;
+	start = now();
+	for(size_t i = 0;i < size;i++) fails += (btree_remove(bt, (i % 2) ? data[i] : -1 - (long)i) != 0);
+	elapsed = now() - start;
+	printf("half miss : %6.2f Mremoves/s (%lu missed)\n", size / elapsed / 1e6, fails);
+}
+
+/**	Random lookups (half hits) with each in-node search kernel, on trees of
+	the same keys at degrees 8 to 256
+**/
+void bench_search(long *data, size_t size, size_t range){
+	const size_t lookups = 2000000;
+	const char *names[] = {"auto", "linear", "binary", "sse4.2", "avx2"};
+
+	long *keys = malloc(lookups * sizeof(*keys));
+	if(keys == NULL){
+		printf("Failed to allocate lookups\n");
+		return;
+	}
+	for(size_t i = 0;i < lookups;i++){
+		keys[i] = (rand() & 1) ? data[rand() % size] : rand() % range;
+	}
+
+	printf("degree ");
+	for(int k = BTREE_SEARCH_LINEAR;k <= BTREE_SEARCH_AVX2;k++) printf("%9s", names[k]);
+	printf("  (Mlookups/s)\n");
+
+	for(unsigned short degree = 8;degree <= 256;degree *= 2){
+		struct btree bt = {degree, 0, NULL};
+		for(size_t i = 0;i < size;i++) btree_insert(&bt, data[i]);
+
+		printf("%6d ", degree);
+		for(int k = BTREE_SEARCH_LINEAR;k <= BTREE_SEARCH_AVX2;k++){
+			if(btree_set_search(k)){
+				printf("%9s", "-");
+				continue;
+			}
+
+			size_t hits = 0;
+			double start = now();
+			for(size_t i = 0;i < lookups;i++) hits += btree_find(&bt, keys[i]);
+			printf("%9.2f", lookups / (now() - start) / 1e6);
+		}
+		printf("\n");
+
+		btree_destroy(&bt);
+	}
+
+	btree_set_search(BTREE_SEARCH_AUTO);
+	free(keys);
+}
+
+/**	Heap bytes per key and lookup time for trees of the same keys at
+	degrees 4 to 256. Bytes come from malloc's own accounting (glibc only),
+	so allocator overhead and padding count too.
+**/
+void bench_memory(long *data, size_t size, size_t range){
+	const size_t lookups = 2000000;
+	long *keys = malloc(lookups * sizeof(*keys));
+	if(keys == NULL){
+		printf("Failed to allocate lookups\n");
+		return;
+	}
+	for(size_t i = 0;i < lookups;i++){
+		keys[i] = (rand() & 1) ? data[rand() % size] : rand() % range;
+	}
+
+	printf("degree  bytes/key  ns/lookup\n");
+	for(unsigned short degree = 4;degree <= 256;degree *= 2){
+		struct btree bt = {degree, 0, NULL};
+		size_t before = heap_bytes();
+		for(size_t i = 0;i < size;i++) btree_insert(&bt, data[i]);
+		double per_key = (double)(heap_bytes() - before) / bt.size;
+
+		size_t hits = 0;
+		double start = now();
+		for(size_t i = 0;i < lookups;i++) hits += btree_find(&bt, keys[i]);
+		double elapsed = now() - start;
+		printf("%6d  %9.2f  %9.1f\n", degree, per_key, elapsed / lookups * 1e9);
+
+		btree_destroy(&bt);
+	}
+
+	free(keys);
+}
+
+/**	Range scans of growing width from random start keys
+**/
+void bench_scan(struct btree *bt, size_t range){
+	const size_t total = 20000000; // Items to scan per width
+	const size_t widths[] = {10, 100, 1000, 100000};
+
+	btree_data_t *out = malloc(widths[3] * sizeof(*out));
+	if(out == NULL){
+		printf("Failed to allocate output\n");
+		return;
+	}
+
+#ifdef BTREE_PLUS
+	printf("B+ tree, linked leaves\n");
+#else
+	printf("B-tree, in-order walk\n");
+#endif
+	for(int w = 0;w < 4;w++){
+		size_t items = 0, scans = 0;
+		double start = now();
+		while(items < total){
+			btree_data_t lo = rand() % range;
+			items += btree_scan(bt, lo, lo + 3 * widths[w], out, widths[w]) + 1; // Keys are 1/3 dense
+			scans++;
+		}
+		double elapsed = now() - start;
+		printf("width %6lu: %8.2f Mitems/s, %7.2f us/scan\n", widths[w], items / elapsed / 1e6, elapsed / scans * 1e6);
+	}
+
+	free(out);
+}
+
+static int cmp_long(const void *a, const void *b){
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**	Build trees of the same keys with the insert loop (random and sorted
+	order) and with btree_bulk_load at several fills. Then look up every
+	key, which also checks the tree.
+**/
+void bench_bulk(long *data, size_t size, unsigned short degree){
+	long *sorted = malloc(size * sizeof(*sorted));
+	if(sorted == NULL){
+		printf("Failed to allocate keys\n");
+		return;
+	}
+	memcpy(sorted, data, size * sizeof(*sorted));
+	qsort(sorted, size, sizeof(*sorted), cmp_long);
+
+	const char *names[] = {"insert random", "insert sorted", "bulk 0.50", "bulk 0.70", "bulk 0.90", "bulk 1.00"};
+	const double fills[] = {0, 0, 0.5, 0.7, 0.9, 1.0};
+	printf("%-14s  %8s  %9s  %9s\n", "build", "ms", "bytes/key", "ns/lookup");
+	for(int b = 0;b < 6;b++){
+		struct btree bt = {degree, 0, NULL};
+		size_t before = heap_bytes();
+		int res = 0;
+		double start = now();
+		if(b == 0){
+			for(size_t i = 0;i < size;i++) res |= btree_insert(&bt, data[i]);
+		}else if(b == 1){
+			for(size_t i = 0;i < size;i++) res |= btree_insert(&bt, sorted[i]);
+		}else{
+			res = btree_bulk_load(&bt, sorted, size, fills[b]);
+		}
+		double elapsed = now() - start;
+		double per_key = (double)(heap_bytes() - before) / size;
+
+		size_t hits = 0;
+		start = now();
+		for(size_t i = 0;i < size;i++) hits += btree_find(&bt, data[i]);
+		double lookup = now() - start;
+
+		printf("%-14s  %8.1f  %9.2f  %9.1f%s\n", names[b], elapsed * 1e3, per_key, lookup / size * 1e9,
+			(res || hits != size || btree_check(&bt)) ? " BAD" : "");
+		btree_destroy(&bt);
+	}
+
+	free(sorted);
+}
+
+/**	Paged tree behind a 4 MiB pool of 4 KiB pages, with data at 1, 4 and 16
+	times the pool. Random inserts, then random lookups (almost all misses,
+	which still read down to a leaf), for each eviction policy. The file is
+	in the OS page cache, so time is mostly pool misses and syscalls; reads
+	per op is the disk independent number.
+**/
+void bench_disk(void){
+	const char *path = "btree-bench.db";
+	const size_t pool = 4 << 20, page = BTREE_DISK_MIN_PAGE, lookups = 1000000;
+	const char *names[] = {"clock", "lru"};
+
+	printf("policy  x pool    keys   Minserts/s  writes/insert  Mlookups/s  reads/lookup\n");
+	for(int scale = 1;scale <= 16;scale *= 4){
+		for(int p = BTREE_EVICT_CLOCK;p <= BTREE_EVICT_LRU;p++){
+			struct btree_disk bd;
+			remove(path);
+			if(btree_disk_open(&bd, path, page, pool, p)){
+				printf("Failed to open %s\n", path);
+				return;
+			}
+
+			// Random inserts leave leaves about 70% full
+			size_t keys = scale * (pool / page) * (bd.degree * 7 / 10);
+			double start = now();
+			for(size_t i = 0;i < keys;i++) btree_disk_insert(&bd, ((long)rand() << 16) ^ rand());
+			double elapsed = now() - start;
+			size_t writes = bd.pool.writes;
+			printf("%-6s %7.1f %8lu %12.3f %14.3f", names[p], (double)bd.pages * page / pool, bd.size,
+				bd.size / elapsed / 1e6, (double)writes / bd.size);
+
+			size_t reads = bd.pool.reads, hits = 0;
+			start = now();
+			for(size_t i = 0;i < lookups;i++) hits += btree_disk_find(&bd, ((long)rand() << 16) ^ rand());
+			elapsed = now() - start;
+			printf(" %11.3f %13.3f\n", lookups / elapsed / 1e6, (double)(bd.pool.reads - reads) / lookups);
+
+			btree_disk_close(&bd);
+		}
+	}
+
+	remove(path);
+}
+
+/**	Increasing keys, like timestamps, against pushing them onto a growing
+	array. Bytes per key as in bench_memory, with a random order build of
+	the same keys for reference.
+**/
+void bench_append(size_t N, unsigned short degree){
+	const char *names[] = {"array push", "append", "random order"};
+	long *keys = malloc(N * sizeof(*keys));
+	if(keys == NULL){
+		printf("Failed to allocate keys\n");
+		return;
+	}
+	for(size_t i = 0;i < N;i++) keys[i] = 1000 * i + rand() % 1000;
+
+	printf("%-13s  %10s  %9s\n", "build", "Minserts/s", "bytes/key");
+	for(int b = 0;b < 3;b++){
+		struct btree bt = {degree, 0, NULL};
+		long *vec = NULL;
+		size_t cap = 0, len = 0;
+		int res = 0;
+		if(b == 2){
+			// Shuffle, then put back in order after
+			for(size_t i = N-1;i > 0;i--){
+				size_t j = rand() % (i+1);
+				long tmp = keys[i];
+				keys[i] = keys[j];
+				keys[j] = tmp;
+			}
+		}
+		size_t before = heap_bytes();
+
+		double start = now();
+		if(b == 0){
+			for(size_t i = 0;i < N;i++){
+				if(len == cap){
+					cap = (cap) ? 2 * cap : 16;
+					long *tmp = realloc(vec, cap * sizeof(*vec));
+					if(tmp == NULL){
+						res = -1;
+						break;
+					}
+					vec = tmp;
+				}
+				vec[len++] = keys[i];
+			}
+		}else{
+			for(size_t i = 0;i < N;i++) res |= btree_insert(&bt, keys[i]);
+		}
+		double elapsed = now() - start;
+		double per_key = (double)(heap_bytes() - before) / N;
+
+		printf("%-13s  %10.2f  %9.2f%s\n", names[b], N / elapsed / 1e6, per_key,
+			(res || (b && (bt.size != N || btree_check(&bt)))) ? " BAD" : "");
+		free(vec);
+		btree_destroy(&bt);
+	}
+
+	free(keys);
+}
+
+/**	Read/write mix from several threads, concurrent tree vs one global mutex
+	around the plain tree. Writes are half inserts, half removes. Keys are
+	drawn from [0, 2N) on a tree preloaded with N.
+**/
+struct conc_args{
+	struct btreec *conc; // NULL for mutex mode
+	struct btree *bt;
+	pthread_mutex_t *lock;
+	int tid;
+	int read_pct;
+	size_t ops;
+	size_t range;
+};
+
+static void *conc_worker(void *arg){
+	struct conc_args *a = arg;
+	unsigned long x = a->tid * 2654435761UL + 1;
+
+	for(size_t i = 0;i < a->ops;i++){
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+
+		long key = x % a->range;
+		int op = (x >> 32) % 100;
+		if(a->conc != NULL){
+			if(op < a->read_pct) btreec_find(a->conc, key);
+			else if(op & 1) btreec_insert(a->conc, key);
+			else btreec_remove(a->conc, key);
+		}else{
+			pthread_mutex_lock(a->lock);
+			if(op < a->read_pct) btree_find(a->bt, key);
+			else if(op & 1) btree_insert(a->bt, key);
+			else btree_remove(a->bt, key);
+			pthread_mutex_unlock(a->lock);
+		}
+	}
+
+	return NULL;
+}
+
+void bench_concurrent(size_t N, unsigned short degree, int max_threads){
+	const int mixes[] = {100, 90, 50, 10}; // Percent reads
+	const size_t ops = 1000000;
+
+	pthread_t *tids = malloc(max_threads * sizeof(*tids));
+	struct conc_args *args = malloc(max_threads * sizeof(*args));
+	if(tids == NULL || args == NULL){
+		printf("Failed to allocate threads\n");
+		free(tids);
+		free(args);
+		return;
+	}
+
+	for(size_t m = 0;m < sizeof(mixes)/sizeof(*mixes);m++){
+		for(int threads = 1;threads <= max_threads;threads *= 2){
+			for(int mode = 0;mode < 2;mode++){
+				struct btreec conc;
+				struct btree bt = {degree, 0, NULL};
+				pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+				if(btreec_init(&conc, (degree < 3) ? 3 : degree)){
+					printf("Failed to create tree\n");
+					break;
+				}
+				for(size_t i = 0;i < 2*N;i += 2){
+					if(mode) btreec_insert(&conc, i);
+					else btree_insert(&bt, i);
+				}
+
+				double start = now();
+				for(int i = 0;i < threads;i++){
+					args[i] = (struct conc_args){(mode) ? &conc : NULL, &bt, &lock, i, mixes[m], ops, 2*N};
+					pthread_create(tids + i, NULL, conc_worker, args + i);
+				}
+				for(int i = 0;i < threads;i++){
+					pthread_join(tids[i], NULL);
+				}
+				double elapsed = now() - start;
+
+				printf("%3d%% reads  %3d threads  %-6s %8.2f Mops/s\n", mixes[m], threads,
+					(mode) ? "btreec" : "mutex", threads * ops / elapsed / 1e6);
+
+				btreec_destroy(&conc);
+				btree_destroy(&bt);
+			}
+		}
+	}
+
+	free(tids);
+	free(args);
+}
+
+int main(int argc, char *argv[]){
+	srand(time(0));
+	const char *mode = "batch";
+	size_t N = 1000000;
+	struct btree bt = {16, 0, NULL};
+
+	long tmpi;
+	if(argc >= 2){
+		mode = argv[1];
+	}
+	if(argc >= 3){
+		tmpi = strtol(argv[2], NULL, 10);
+		if(tmpi > 0) N = tmpi;
+	}
+	if(argc >= 4){
+		tmpi = strtol(argv[3], NULL, 10);
+		if(tmpi > 0) bt.degree = tmpi;
+	}
+
+	printf("Benchmarking %s with %lu keys, degree %d..\n", mode, N, bt.degree);
+
+	long *data = malloc(N * sizeof(*data));
+	if(data == NULL){
+		printf("Failed to allocate keys\n");
+		return 1;
+	}
+
+	size_t size = 0;
+	long val;
+	for(size_t i = 0;i < N;i++){
+		val = rand() % (3*N);
+		if(btree_insert(&bt, val) == 0) data[size++] = val;
+	}
+
+	if(!strcmp(mode, "batch")){
+		bench_batch(&bt, data, size, 3*N);
+	}else if(!strcmp(mode, "remove")){
+		bench_remove(&bt, data, size);
+	}else if(!strcmp(mode, "search")){
+		bench_search(data, size, 3*N);
+	}else if(!strcmp(mode, "memory")){
+		bench_memory(data, size, 3*N);
+	}else if(!strcmp(mode, "scan")){
+		bench_scan(&bt, 3*N);
+	}else if(!strcmp(mode, "bulk")){
+		bench_bulk(data, size, bt.degree);
+	}else if(!strcmp(mode, "disk")){
+		bench_disk();
+	}else if(!strcmp(mode, "concurrent")){
+		bench_concurrent(N, bt.degree, 8);
+	}else if(!strcmp(mode, "append")){
+		bench_append(N, bt.degree);
+	}else{
+		printf("Unknown mode '%s'. Modes: batch remove search memory scan bulk disk concurrent append\n", mode);
+	}
+
+	btree_destroy(&bt);
+	free(data);
+
+	return 0;
+}
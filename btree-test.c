@@ -1,7 +1,85 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include<time.h>
+#include<pthread.h>
 #include"btree.h"
+#include"btreedisk.h"
+#include"btreec.h"
+
+/**	Readers run while two writers churn the keys that are 2 mod 4, each
+	writer its own half of them. Multiples of 4 are always present and odd
+	numbers never are, so readers can check both.
+**/
+#define CONC_RANGE 40000
+struct btreec conc;
+atomic_int conc_stop;
+atomic_long conc_bad;
+char conc_in[CONC_RANGE];
+
+void *conc_reader(void *arg){
+	unsigned x = (long)arg * 7919 + 1;
+
+	while(!atomic_load(&conc_stop)){
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+
+		long key = x % CONC_RANGE;
+		int found = btreec_find(&conc, key);
+		if((key % 4 == 0 && !found) || (key % 2 == 1 && found)) atomic_fetch_add(&conc_bad, 1);
+	}
+
+	return NULL;
+}
+
+void *conc_writer(void *arg){
+	long w = (long)arg, ops = 4 * CONC_RANGE;
+	unsigned x = w * 31 + 7;
+
+	for(long i = 0;i < ops;i++){
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+
+		long key = ((x % (CONC_RANGE / 8)) * 2 + w) * 4 + 2;
+		if(x & (1 << 20)){
+			if((btreec_insert(&conc, key) == 0) == conc_in[key]) atomic_fetch_add(&conc_bad, 1);
+			conc_in[key] = 1;
+		}else{
+			if((btreec_remove(&conc, key) == 0) != conc_in[key]) atomic_fetch_add(&conc_bad, 1);
+			conc_in[key] = 0;
+		}
+	}
+
+	return NULL;
+}
+
+int check_concurrent(unsigned short degree){
+	pthread_t readers[3], writers[2];
+
+	if(btreec_init(&conc, (degree < 3) ? 3 : degree)) return -1;
+	for(long k = 0;k < CONC_RANGE;k += 4){
+		btreec_insert(&conc, k);
+	}
+
+	for(long i = 0;i < 3;i++) pthread_create(readers + i, NULL, conc_reader, (void *)i);
+	for(long i = 0;i < 2;i++) pthread_create(writers + i, NULL, conc_writer, (void *)i);
+	for(int i = 0;i < 2;i++) pthread_join(writers[i], NULL);
+	atomic_store(&conc_stop, 1);
+	for(int i = 0;i < 3;i++) pthread_join(readers[i], NULL);
+
+	long bad = atomic_load(&conc_bad);
+	size_t count = 0;
+	for(long k = 0;k < CONC_RANGE;k++){
+		int found = btreec_find(&conc, k);
+		if(found != (k % 4 == 0 || conc_in[k])) bad++;
+		count += found;
+	}
+	if(count != atomic_load(&conc.size)) bad++;
+	btreec_destroy(&conc);
+
+	return (bad != 0);
+}
 
 int main(int argc, char *argv[]){
 	srand(time(0));
@@ -18,6 +96,12 @@ int main(int argc, char *argv[]){
 		if(tmpi > 0) bt.degree = tmpi;
 	}
 
+	if(bt.degree < BTREE_MIN_DEGREE){
+		printf("Degree %d is below minimum, insert %s. Using %d\n", bt.degree,
+			(btree_insert(&bt, 0)) ? "rejected it" : "WARNING: accepted it", BTREE_MIN_DEGREE);
+		bt.degree = BTREE_MIN_DEGREE;
+	}
+
 	printf("Inserting %7ld data to b-tree with degree %3d\n", N, bt.degree);
 
 	int val, dups = 0;
@@ -54,9 +138,162 @@ int main(int argc, char *argv[]){
 		}
 	}
 
+	if(btree_check(&bt)){
+		printf("WARNING: Tree structure is bad after inserts\n");
+	}
+
+	// Random inserts and removes, compared to a membership table
+	printf("Stress testing inserts and removes..\n");
+	char *in = calloc(8*N + 1, sizeof(*in));
+	for(int i = 0;i < size;i++) in[data[i]] = 1;
+
+	int bad = 0;
+	for(int i = 0;i < 4*N && !bad;i++){
+		val = rand() % (8*N + 1);
+		if(rand() % 2){
+			res = btree_insert(&bt, val);
+			if((res == 0) == in[val]){
+				printf("WARNING: insert of %d returned %d\n", val, res);
+				bad = 1;
+			}
+			in[val] = 1;
+		}else{
+			res = btree_remove(&bt, val);
+			if((res == 0) != in[val]){
+				printf("WARNING: remove of %d returned %d\n", val, res);
+				bad = 1;
+			}
+			in[val] = 0;
+		}
+
+		if(i % 256 == 0 && btree_check(&bt)){
+			printf("WARNING: Tree structure is bad after %d operations\n", i);
+			bad = 1;
+		}
+	}
+	for(int i = 0;i <= 8*N && !bad;i++){
+		if(btree_find(&bt, i) != in[i]){
+			printf("WARNING: find of %d is wrong after removes\n", i);
+			bad = 1;
+		}
+	}
+
+	// Range scans against the table, some cut short by max
+	btree_data_t *out = malloc((8*N + 1) * sizeof(*out));
+	for(int i = 0;i < 200 && !bad;i++){
+		int lo = rand() % (8*N + 1), hi = lo + rand() % (N + 1), max = rand() % (N + 1);
+		size_t cnt = btree_scan(&bt, lo, hi, out, max), expect = 0;
+		for(int j = lo;j < hi && j <= 8*N && expect < max;j++){
+			if(!in[j]) continue;
+			if(expect >= cnt || out[expect] != j) break;
+			expect++;
+		}
+		if(expect != cnt){
+			printf("WARNING: scan of [%d, %d) max %d returned %lu items\n", lo, hi, max, cnt);
+			bad = 1;
+		}
+	}
+	free(out);
+
+	// Remove everything left, so the root has to shrink away
+	for(int i = 0;i <= 8*N && !bad;i++){
+		if(in[i] && btree_remove(&bt, i)){
+			printf("WARNING: final remove of %d failed\n", i);
+			bad = 1;
+		}
+	}
+	if(!bad && (bt.size != 0 || bt.root != NULL || btree_check(&bt))){
+		printf("WARNING: Tree not empty after removing everything\n");
+		bad = 1;
+	}
+	printf("Stress test %s\n", (bad) ? "FAILED" : "passed");
+
+	// Bulk load the odd keys into the now empty tree, then check each one
+	printf("Bulk loading %d data..\n", 4*N);
+	btree_data_t *sorted = malloc((4*N + 1) * sizeof(*sorted));
+	for(int i = 0;i < 4*N;i++) sorted[i] = 2*i + 1;
+	bad = (bt.root != NULL || btree_bulk_load(&bt, sorted, 4*N, 0.75) || btree_check(&bt) || bt.size != 4*N);
+	for(int i = 0;i <= 8*N && !bad;i++){
+		if(btree_find(&bt, i) != (i % 2)){
+			printf("WARNING: find of %d is wrong after bulk load\n", i);
+			bad = 1;
+		}
+	}
+
+	// Smaller loads at every low degree, some fills and sizes, each then
+	// changed a little to see remove and insert still work on the result
+	const double fills[] = {0.1, 0.5, 0.75, 1.0};
+	for(unsigned short degree = 1;degree <= 9 && !bad;degree = (degree == 8) ? 64 : degree + 1){
+		for(int f = 0;f < 4 && !bad;f++){
+			for(int n = 0;n <= 4*N && n <= 600 && !bad;n += 1 + n / 8){
+				struct btree small = {degree, 0, NULL};
+				if(btree_bulk_load(&small, sorted, n, fills[f])){
+					bad = (degree >= BTREE_MIN_DEGREE);
+					continue;
+				}
+				bad = (degree < BTREE_MIN_DEGREE || btree_check(&small) || small.size != n);
+				for(int i = 0;i < n && !bad;i += 3) bad = btree_remove(&small, sorted[i]);
+				for(int i = 0;i < n && !bad;i += 2) bad = btree_insert(&small, sorted[i] + 1);
+				if(!bad) bad = btree_check(&small);
+				if(bad) printf("WARNING: bulk load of %d at degree %d, fill %.2f is bad\n", n, degree, fills[f]);
+				btree_destroy(&small);
+			}
+		}
+	}
+	printf("Bulk load %s\n", (bad) ? "FAILED" : "passed");
+	free(sorted);
+
+	// Increasing keys take the append path, then remove every third one
+	printf("Appending %d data..\n", 4*N);
+	struct btree app = {bt.degree, 0, NULL};
+	bad = 0;
+	for(int i = 0;i < 4*N && !bad;i++){
+		bad = (btree_insert(&app, 3*i) || btree_insert(&app, 3*i) == 0);
+	}
+	for(int i = 0;i < 4*N && !bad;i += 3) bad = btree_remove(&app, 3*i);
+	for(int i = 0;i < 12*N && !bad;i++){
+		bad = (btree_find(&app, i) != (i % 3 == 0 && i % 9 != 0));
+	}
+	if(!bad) bad = (btree_check(&app) || btree_insert(&app, 12*N) || btree_check(&app));
+	app.degree = BTREE_MIN_DEGREE - 1; // Too small, nothing may go in
+	if(!bad) bad = (btree_insert(&app, 12*N + 1) == 0 || btree_find(&app, 12*N + 1));
+	app.degree = bt.degree;
+	printf("Append %s\n", (bad) ? "FAILED" : "passed");
+	btree_destroy(&app);
+
+	// Same inserts into a paged tree with the smallest pool, then reopened
+	printf("Checking paged tree..\n");
+	const char *path = "btree-test.db";
+	struct btree_disk bd;
+	remove(path);
+	bad = btree_disk_open(&bd, path, BTREE_DISK_MIN_PAGE, 0, BTREE_EVICT_CLOCK);
+	for(int i = 0;i < size && !bad;i++){
+		if(btree_disk_insert(&bd, data[i]) || btree_disk_insert(&bd, data[i]) == 0){
+			printf("WARNING: paged insert of %d failed\n", data[i]);
+			bad = 1;
+		}
+	}
+	if(!bad && (btree_disk_close(&bd) || btree_disk_open(&bd, path, 0, 0, BTREE_EVICT_LRU) || bd.size != size)){
+		printf("WARNING: paged tree reopen failed\n");
+		bad = 1;
+	}
+	for(int i = 0;i < size && !bad;i++){
+		if(!btree_disk_find(&bd, data[i]) || btree_disk_find(&bd, -1 - i)){
+			printf("WARNING: paged find of %d is wrong\n", data[i]);
+			bad = 1;
+		}
+	}
+	if(bd.fd >= 0) btree_disk_close(&bd);
+	remove(path);
+	printf("Paged tree %s\n", (bad) ? "FAILED" : "passed");
+
+	printf("Checking concurrent tree..\n");
+	printf("Concurrent tree %s\n", (check_concurrent(bt.degree)) ? "FAILED" : "passed");
+
 	// Clear
 	btree_destroy(&bt);
 	free(data);
+	free(in);
 
 	return 0;
 }
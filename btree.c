@@ -1,24 +1,174 @@
 #include"btree.h"
 
+#ifdef __GNUC__
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr)
+#endif
+
+#define CACHE_LINE 64
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BTREE_X86
+#include<immintrin.h>
+#endif
+
+#ifdef BTREE_PLUS
+#define PLUS_MODE 1
+#else
+#define PLUS_MODE 0
+#endif
+
+#ifndef BTREE_SEARCH_DEFAULT
+#define BTREE_SEARCH_DEFAULT BTREE_SEARCH_AUTO
+#endif
+
+/**	In-node search kernels. All return the number of keys less than key,
+	which is the index of key if present, or the child to descend into.
+**/
+static int search_linear(const btree_data_t *keys, int n, btree_data_t key){
+	int stop = 0;
+	while(stop < n && key > keys[stop]){
+		stop++;
+	}
+
+	return stop;
+}
+
+/**	Halve the range with a conditional move instead of a branch, so the
+	loop runs log2(n) times whatever the keys are.
+**/
+static int search_binary(const btree_data_t *keys, int n, btree_data_t key){
+	if(n == 0) return 0;
+
+	const btree_data_t *base = keys;
+	int half;
+	while(n > 1){
+		half = n / 2;
+		base = (base[half - 1] < key) ? base + half : base;
+		n -= half;
+	}
+
+	return (base - keys) + (*base < key);
+}
+
+#ifdef BTREE_X86
+/**	Compare a vector of keys at once and count the ones below key. Keys are
+	sorted, so stop at the first vector that is not entirely below.
+**/
+__attribute__((target("sse4.2,popcnt")))
+static int search_sse42(const btree_data_t *keys, int n, btree_data_t key){
+	const __m128i k = _mm_set1_epi64x(key);
+	int i = 0, mask;
+	for(;i + 2 <= n;i += 2){
+		mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(k, _mm_loadu_si128((const __m128i *)(keys + i)))));
+		if(mask != 0x3) return i + __builtin_popcount(mask);
+	}
+
+	return i + (i < n && keys[i] < key);
+}
+
+__attribute__((target("avx2,popcnt")))
+static int search_avx2(const btree_data_t *keys, int n, btree_data_t key){
+	const __m256i k = _mm256_set1_epi64x(key);
+	int i = 0, mask;
+	for(;i + 4 <= n;i += 4){
+		mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, _mm256_loadu_si256((const __m256i *)(keys + i)))));
+		if(mask != 0xF) return i + __builtin_popcount(mask);
+	}
+
+	return i + search_linear(keys + i, n - i, key);
+}
+#endif
+
+static int (*node_search)(const btree_data_t *, int, btree_data_t) = search_linear;
+
+int btree_set_search(enum btree_search kind){
+#ifdef BTREE_X86
+	__builtin_cpu_init();
+	int avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+	int sse42 = __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+#else
+	int avx2 = 0, sse42 = 0;
+#endif
+
+	switch(kind){
+	case BTREE_SEARCH_AUTO:
+		// Linear vector scan beats binary search at the degrees used here
+		if(avx2) return btree_set_search(BTREE_SEARCH_AVX2);
+		if(sse42) return btree_set_search(BTREE_SEARCH_SSE42);
+		return btree_set_search(BTREE_SEARCH_BINARY);
+	case BTREE_SEARCH_LINEAR:
+		node_search = search_linear;
+		return 0;
+	case BTREE_SEARCH_BINARY:
+		node_search = search_binary;
+		return 0;
+#ifdef BTREE_X86
+	case BTREE_SEARCH_SSE42:
+		if(!sse42) return -1;
+		node_search = search_sse42;
+		return 0;
+	case BTREE_SEARCH_AVX2:
+		if(!avx2) return -1;
+		node_search = search_avx2;
+		return 0;
+#endif
+	default:
+		return -1;
+	}
+}
+
+int btree_node_search(const btree_data_t *keys, int n, btree_data_t key){
+	return node_search(keys, n, key);
+}
+
+#ifdef __GNUC__
+// Pick the default kernel when the program loads
+__attribute__((constructor))
+static void btree_pick_search(void){
+	btree_set_search(BTREE_SEARCH_DEFAULT);
+}
+#endif
+
+/**	Each node is one cache line aligned block: this header, degree+1 keys
+	(one spare for overflow before a split), then degree+2 child pointers
+	for inner nodes only. Leaves have no child array and nodes is NULL.
+	In B+ mode all keys are in leaves, inner keys are only separators (the
+	smallest key of the subtree to their right), and leaves are chained.
+**/
 struct btreeNode{
-	btree_data_t *data; // Data array
-	struct btreeNode **nodes; // Child node array
 	size_t size; // Amount of data in this node
+	struct btreeNode **nodes; // Child node array, inside the same block
+#ifdef BTREE_PLUS
+	struct btreeNode *next; // Leaf chain, NULL for inner nodes
+	struct btreeNode *prev;
+#endif
+	btree_data_t data[]; // Data array
 };
 
+/**	Child to descend into, given stop keys below data. A B+ separator equal
+	to data sends it right.
+**/
+static inline int child_index(struct btreeNode const *bt, int stop, const btree_data_t data){
+	return stop + (PLUS_MODE && stop < bt->size && bt->data[stop] == data);
+}
+
+void free_btree_node(struct btreeNode *node){
+	free(node);
+}
+
 void _btree_destroy(struct btreeNode **bt, const unsigned short degree){
 	if(bt == NULL || *bt == NULL) return;
 
 	// Recursively delete all child nodes
-	for(int i = 0;i <= (*bt)->size;i++){
-		_btree_destroy((*bt)->nodes + i, degree);
-		(*bt)->nodes[i] = NULL;
+	if((*bt)->nodes != NULL){
+		for(int i = 0;i <= (*bt)->size;i++){
+			_btree_destroy((*bt)->nodes + i, degree);
+		}
 	}
 
-	// Delete data and node arrays
-	free((*bt)->data);
-	free((*bt)->nodes);
-	free(*bt);
+	free_btree_node(*bt);
 	(*bt) = NULL;
 }
 
@@ -26,40 +176,98 @@ void btree_destroy(struct btree *bt){
 	if(bt == NULL) return;
 
 	_btree_destroy(&bt->root, bt->degree);
+	bt->last = NULL;
 }
 
-/**	Allocation helper for btreeNode, since error code is large
+/**	Allocation helper for btreeNode. Block is rounded up to whole cache lines
 **/
-struct btreeNode *create_btree_node(unsigned short degree){
-	struct btreeNode *ret = NULL;
-	void *tmp = NULL;
-	// Alloc node
-	tmp = malloc(sizeof(*ret));
-	if(tmp == NULL){
-		return NULL;
-	}
-	ret = tmp;
+struct btreeNode *create_btree_node(unsigned short degree, int leaf){
+	size_t keys = sizeof(struct btreeNode) + (degree+1) * sizeof(btree_data_t);
+	size_t bytes = keys + ((leaf) ? 0 : (degree+2) * sizeof(struct btreeNode *));
+	bytes = (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
 
-	// Alloc data array (degree+1) for extra slot
-	tmp = calloc((degree+1), sizeof(*ret->data));
-	if(tmp == NULL){
+	struct btreeNode *ret = aligned_alloc(CACHE_LINE, bytes);
+	if(ret == NULL){
 		return NULL;
 	}
-	ret->data = tmp;
-
-	// Alloc nodes array as NULLs (degree+1+1) for extra slot (in addition to normal +1)
-	tmp = calloc((degree+2), sizeof(*ret->nodes));
-	if(tmp == NULL){
-		return NULL;
-	}
-	ret->nodes = tmp;
 
 	// Set values
 	ret->size = 0;
+	ret->nodes = NULL;
+#ifdef BTREE_PLUS
+	ret->next = NULL;
+	ret->prev = NULL;
+#endif
+	if(!leaf){
+		ret->nodes = (struct btreeNode **)((char *)ret + keys);
+		memset(ret->nodes, 0, (degree+2) * sizeof(*ret->nodes));
+	}
 
 	return ret;
 }
 
+/**	Nodes taken before an insert changes anything, one for each split it
+	will make, so running out of memory leaves the tree as it was. Spare
+	inner nodes are chained through nodes[0].
+**/
+struct btreeSpare{
+	struct btreeNode *leaf;
+	struct btreeNode *inner;
+};
+
+static struct btreeNode *take_spare(struct btreeSpare *spare, int leaf){
+	struct btreeNode *node;
+	if(leaf){
+		node = spare->leaf;
+		spare->leaf = NULL;
+	}else{
+		node = spare->inner;
+		spare->inner = node->nodes[0];
+		node->nodes[0] = NULL;
+	}
+
+	return node;
+}
+
+static void free_spares(struct btreeSpare *spare){
+	if(spare->leaf != NULL) free_btree_node(take_spare(spare, 1));
+	while(spare->inner != NULL) free_btree_node(take_spare(spare, 0));
+}
+
+/**	Move keys (and children) after index res of an overflowing node into a
+	spare right node, leaving res keys in old. Key res is what gets lifted.
+	A B+ leaf keeps it as the first key of the right node instead.
+	Returns new right node
+**/
+struct btreeNode *_btree_split(struct btreeNode *old, int res, struct btreeSpare *spare){
+	struct btreeNode *tmp = take_spare(spare, old->nodes == NULL);
+
+#ifdef BTREE_PLUS
+	if(old->nodes == NULL){
+		tmp->size = old->size - res;
+		memcpy(tmp->data, old->data + res, tmp->size * sizeof(*old->data));
+		old->size = res;
+
+		// Link in after old
+		tmp->next = old->next;
+		tmp->prev = old;
+		if(old->next != NULL) old->next->prev = tmp;
+		old->next = tmp;
+
+		return tmp;
+	}
+#endif
+
+	size_t back = old->size - res - 1;
+	memcpy(tmp->data, old->data + (res + 1), (back) * sizeof(*old->data));
+	if(old->nodes != NULL) memcpy(tmp->nodes, old->nodes + (res + 1), (back+1) * sizeof(*old->nodes));
+
+	tmp->size = back;
+	old->size = res; // Old size simply halved (rounding in favor)
+
+	return tmp;
+}
+
 /**
 Let degree be amount of data per node (not including extra 1 at end of each array)
 TODO: Implement this process
@@ -89,24 +297,24 @@ Process:
 		Return 0
 
 	lift -- data that needs to be pushed up to parent
-	Returns negative for error, strictly positive (> 0) for lift data
+	edge -- nonzero if bt is on the right edge of the tree
+	spare -- nodes for every split this insert makes
+	Returns negative for duplicate, strictly positive (> 0) for lift data
 **/
-int _btree_insert(struct btreeNode *bt, const btree_data_t data, unsigned short degree, btree_data_t *lift){
+int _btree_insert(struct btreeNode *bt, const btree_data_t data, unsigned short degree, btree_data_t *lift, int edge, struct btreeSpare *spare){
 	if(bt == NULL) return 0;
 
 	int res = 0;
-	int stop = 0;
-	while(stop < bt->size && data > bt->data[stop]){
-		stop++;
-	}
+	int stop = node_search(bt->data, bt->size, data);
+	int append = edge && stop == bt->size; // New largest key in the tree
 
 	//printf("Stop index: %2d\n", stop);
-	if(data == bt->data[stop]){
+	if(stop < bt->size && data == bt->data[stop] && (!PLUS_MODE || bt->nodes == NULL)){
 		//printf("Can't insert duplicate data = %ld.\n", data);
 		return -1;
 	}
 
-	if(bt->nodes[stop] == NULL){
+	if(bt->nodes == NULL){
 		// Insert here at "leaf"
 		//printf("Inserting %ld at %p\n", data, bt);
 
@@ -121,7 +329,8 @@ int _btree_insert(struct btreeNode *bt, const btree_data_t data, unsigned short
 	}else{
 		// Recurse
 		//printf("Recursing\n");
-		res = _btree_insert(bt->nodes[stop], data, degree, lift);
+		stop = child_index(bt, stop, data);
+		res = _btree_insert(bt->nodes[stop], data, degree, lift, append, spare);
 		if(res > 0){
 			// Cleave node
 			//printf("Cleaving node at %2d with data %ld\n", stop, *lift);
@@ -140,27 +349,11 @@ int _btree_insert(struct btreeNode *bt, const btree_data_t data, unsigned short
 			// Place new data
 			bt->data[stop] = *lift;
 
-			// Create new right node
-			tmp = create_btree_node(degree); // tmp is new right node
-			if(tmp == NULL){
-				return -1;
-			}
+			// Create new right node with back half of the old one
+			tmp = _btree_split(bt->nodes[stop], res, spare); // tmp is new right node
 			bt->nodes[stop+1] = tmp;
 			//printf("New right node = %p @ %2d\n", tmp, stop+1);
 
-			// Copy back half data to new right node from original node, and set size
-			struct btreeNode *old = bt->nodes[stop];
-			//printf("Old = %p @ %2d\n", old, stop);
-			size_t back = old->size - res - 1;
-			//printf("Moving data and nodes from %2d for %3d and %3d units\n", res+1, back, back+1);
-			memcpy(tmp->data, old->data + (res + 1), (back) * sizeof(*old->data)); // NEW
-			memcpy(tmp->nodes, old->nodes + (res + 1), (back+1) * sizeof(*old->nodes)); // NEW
-
-			// Update new and old node sizes
-			//printf("Old size: %2ld\n", old->size);
-			tmp->size = (old->size - 1)/2;
-			old->size /= 2; // Old size simply halved (rounding in favor)
-
 			bt->size++; // Increment this node size and reset return
 			res = 0;
 		}
@@ -168,27 +361,85 @@ int _btree_insert(struct btreeNode *bt, const btree_data_t data, unsigned short
 
 	// Check if node full ==> push median value up
 	if(bt->size > degree){
-		*lift = bt->data[bt->size / 2];
+		// Appends only ever fill the right edge, so leave this node full and
+		// move just the newest key on. A B+ leaf keeps the lifted key on the right
+		res = (append && bt->size >= 3) ? bt->size - 2 + (PLUS_MODE && bt->nodes == NULL) : bt->size / 2;
+		*lift = bt->data[res];
 		//printf("Pushing up data = %ld\n", *lift);
-
-		res = bt->size / 2;
 	}
 
 	return res;
 }
 
-/**	Insert node and handle pushed data, which could create new root
-	TODO: Maybe reject degree 1?
+static inline struct btreeNode *rightmost_leaf(struct btreeNode *node){
+	while(node->nodes != NULL) node = node->nodes[node->size];
+
+	return node;
+}
+
+/**	Take the nodes inserting data will split into: one for the leaf if it
+	is full, then one for each full node above it in turn, and a new root
+	once they all are. Sets *split if the leaf splits, and *edge if it is
+	the rightmost leaf. Returns nonzero if out of memory, taking nothing.
+**/
+static int take_spares(struct btree *bt, const btree_data_t data, struct btreeSpare *spare, int *split, int *edge){
+	struct btreeNode *node = bt->root;
+	int full = 0, depth = 0, stop;
+
+	*edge = 1;
+	for(;;){
+		full = (node->size >= bt->degree) ? full + 1 : 0; // Full nodes just above here
+		depth++;
+		if(node->nodes == NULL) break;
+
+		stop = child_index(node, node_search(node->data, node->size, data), data);
+		*edge = *edge && stop == node->size;
+		node = node->nodes[stop];
+	}
+
+	spare->leaf = NULL;
+	spare->inner = NULL;
+	*split = (full > 0);
+	if(full == 0) return 0;
+
+	spare->leaf = create_btree_node(bt->degree, 1);
+	for(int i = full - 1 + (full == depth);i > 0 && spare->leaf != NULL;i--){
+		node = create_btree_node(bt->degree, 0);
+		if(node == NULL){
+			free_spares(spare);
+			break;
+		}
+		node->nodes[0] = spare->inner;
+		spare->inner = node;
+	}
+	if(spare->leaf == NULL){
+		free_spares(spare);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**	Insert node and handle pushed data, which could create new root.
+	Degree below BTREE_MIN_DEGREE is rejected.
 **/
 int btree_insert(struct btree *bt, const btree_data_t data){
-	if(bt == NULL) return -1;
+	if(bt == NULL || bt->degree < BTREE_MIN_DEGREE) return -1;
+
+	// Appends go straight into the rightmost leaf while it has room. It is
+	// never empty, and its last key is the largest in the tree
+	struct btreeNode *tmp = bt->last;
+	if(tmp != NULL && tmp->size < bt->degree && data > tmp->data[tmp->size - 1]){
+		tmp->data[tmp->size++] = data;
+		bt->size++;
+		return 0;
+	}
 
-	struct btreeNode *tmp;
 	// If root nodes doesn't exist, create it
 	if(bt->root == NULL){
 		//printf("Creating root..\n");
 		// Alloc node
-		tmp = create_btree_node(bt->degree);
+		tmp = create_btree_node(bt->degree, 1);
 		if(tmp == NULL){
 			return -1;
 		}
@@ -198,18 +449,23 @@ int btree_insert(struct btree *bt, const btree_data_t data){
 		bt->root->size = 1;
 		bt->root->data[0] = data;
 		bt->size = 1;
+		bt->last = tmp;
 
 		return 0;
 	}
 
+	// Every node a split needs is taken first, so nothing can fail part way
+	struct btreeSpare spare;
+	int split, edge;
+	if(take_spares(bt, data, &spare, &split, &edge)) return -1;
+
 	// Call recursive insert, and give parameter to push data with
 	btree_data_t up;
-	int res = _btree_insert(bt->root, data, bt->degree, &up);
+	int res = _btree_insert(bt->root, data, bt->degree, &up, 1, &spare);
 
-	// If error, return immediately. If success, increment size and return.
-	if(res < 0) return res;
-	if(res == 0){
-		bt->size++;
+	// If duplicate, return immediately
+	if(res < 0){
+		free_spares(&spare);
 		return res;
 	}
 
@@ -217,40 +473,302 @@ int btree_insert(struct btree *bt, const btree_data_t data){
 	*/
 	//printf("Res = %3d\tpushed data = %ld\n", res, up);
 	//btree_print(bt);
+	if(res > 0){
+		struct btreeNode *root = take_spare(&spare, 0);
+		tmp = _btree_split(bt->root, res, &spare); // tmp is new right node
+
+		// Insert data to new root node, and assign old root and right node
+		root->data[0] = up;
+		root->size = 1;
+		root->nodes[0] = bt->root;
+		root->nodes[1] = tmp;
+		bt->root = root;
+	}
 
-	// Create new root
-	tmp = create_btree_node(bt->degree);
-	if(tmp == NULL){
-		return -1;
+	bt->size++; // Increment tree size
+
+	// Only a split of the rightmost leaf moves it
+	if(bt->last == NULL || (split && edge)) bt->last = rightmost_leaf(bt->root);
+
+	return 0;
+}
+
+// Fewest keys a node other than the root may hold
+#define BTREE_MIN(degree) ((degree) / 2)
+
+/**	Merge child j+1 and separator j into child j, removing both from parent.
+	Only done when the result fits in degree keys.
+**/
+void _btree_merge(struct btreeNode *parent, int j){
+	struct btreeNode *left = parent->nodes[j];
+	struct btreeNode *right = parent->nodes[j+1];
+
+#ifdef BTREE_PLUS
+	if(left->nodes == NULL){
+		// Leaves just concatenate, the separator is not a key
+		memcpy(left->data + left->size, right->data, right->size * sizeof(*right->data));
+		left->size += right->size;
+
+		left->next = right->next;
+		if(right->next != NULL) right->next->prev = left;
+	}else
+#endif
+	{
+		left->data[left->size] = parent->data[j];
+		memcpy(left->data + left->size + 1, right->data, right->size * sizeof(*right->data));
+		if(left->nodes != NULL){
+			memcpy(left->nodes + left->size + 1, right->nodes, (right->size + 1) * sizeof(*right->nodes));
+		}
+		left->size += right->size + 1;
+	}
+
+	memmove(parent->data + j, parent->data + j + 1, (parent->size - j - 1) * sizeof(*parent->data));
+	memmove(parent->nodes + j + 1, parent->nodes + j + 2, (parent->size - j - 1) * sizeof(*parent->nodes));
+	parent->nodes[parent->size] = NULL;
+	parent->size--;
+
+	free_btree_node(right);
+}
+
+/**	Child i of parent dropped below minimum. Rotate a key through the parent
+	from a sibling that can spare one, otherwise merge with a sibling.
+**/
+void _btree_fix_underflow(struct btreeNode *parent, int i, const unsigned short degree){
+	struct btreeNode *child = parent->nodes[i];
+	if(child->size >= BTREE_MIN(degree)) return;
+
+	struct btreeNode *sib;
+#ifdef BTREE_PLUS
+	if(child->nodes == NULL && i > 0 && parent->nodes[i-1]->size > BTREE_MIN(degree)){
+		// Move last key of left leaf over, it becomes the separator
+		sib = parent->nodes[i-1];
+		memmove(child->data + 1, child->data, child->size * sizeof(*child->data));
+		child->data[0] = sib->data[--sib->size];
+		child->size++;
+		parent->data[i-1] = child->data[0];
+		return;
+	}else if(child->nodes == NULL && i < parent->size && parent->nodes[i+1]->size > BTREE_MIN(degree)){
+		// Move first key of right leaf over, its new first key is the separator
+		sib = parent->nodes[i+1];
+		child->data[child->size++] = sib->data[0];
+		memmove(sib->data, sib->data + 1, (sib->size - 1) * sizeof(*sib->data));
+		sib->size--;
+		parent->data[i] = sib->data[0];
+		return;
 	}
+#endif
+
+	if(i > 0 && parent->nodes[i-1]->size > BTREE_MIN(degree)){
+		// Borrow from left sibling
+		sib = parent->nodes[i-1];
+		memmove(child->data + 1, child->data, child->size * sizeof(*child->data));
+		child->data[0] = parent->data[i-1];
+		parent->data[i-1] = sib->data[sib->size - 1];
+
+		if(child->nodes != NULL){
+			memmove(child->nodes + 1, child->nodes, (child->size + 1) * sizeof(*child->nodes));
+			child->nodes[0] = sib->nodes[sib->size];
+			sib->nodes[sib->size] = NULL;
+		}
+		sib->size--;
+		child->size++;
+	}else if(i < parent->size && parent->nodes[i+1]->size > BTREE_MIN(degree)){
+		// Borrow from right sibling
+		sib = parent->nodes[i+1];
+		child->data[child->size] = parent->data[i];
+		parent->data[i] = sib->data[0];
+		memmove(sib->data, sib->data + 1, (sib->size - 1) * sizeof(*sib->data));
+
+		if(child->nodes != NULL){
+			child->nodes[child->size + 1] = sib->nodes[0];
+			memmove(sib->nodes, sib->nodes + 1, sib->size * sizeof(*sib->nodes));
+			sib->nodes[sib->size] = NULL;
+		}
+		sib->size--;
+		child->size++;
+	}else if(i > 0){
+		_btree_merge(parent, i-1);
+	}else if(i < parent->size){
+		_btree_merge(parent, i);
+	}
+}
 
-	// Insert data to new root node
-	tmp->data[0] = up;
-	tmp->size = 1;
+/**	Remove largest key of subtree into max, fixing underflow on the way up
+**/
+void _btree_remove_max(struct btreeNode *bt, const unsigned short degree, btree_data_t *max){
+	if(bt->nodes == NULL){
+		*max = bt->data[bt->size - 1];
+		bt->size--;
+		return;
+	}
 
-	// Assign old root
-	tmp->nodes[0] = bt->root;
-	bt->root = tmp;
+	int last = bt->size;
+	_btree_remove_max(bt->nodes[last], degree, max);
+	_btree_fix_underflow(bt, last, degree);
+}
 
-	// Create new right node
-	tmp = create_btree_node(bt->degree); // tmp is new right node
-	if(tmp == NULL){
+/**	Same descent as insert. A key in an inner node is replaced by its
+	predecessor, pulled out of the leaf below (B+ keys are all in leaves). Every child that was
+	removed from is fixed on the way back up, so only the root can end
+	up under minimum.
+	edge -- nonzero if bt is on the right edge of the tree
+	Returns 0 if removed, 1 if removed and a borrow or merge touched the
+	rightmost child of a node on the edge, negative if not found
+**/
+int _btree_remove(struct btreeNode *bt, const btree_data_t data, const unsigned short degree, int edge){
+	if(bt == NULL) return -1;
+
+	int stop = node_search(bt->data, bt->size, data);
+
+	int found = (stop < bt->size && bt->data[stop] == data);
+	if(bt->nodes == NULL){
+		// Leaf
+		if(!found) return -1;
+
+		memmove(bt->data + stop, bt->data + stop + 1, (bt->size - stop - 1) * sizeof(*bt->data));
+		bt->size--;
+		return 0;
+	}
+
+	int res = 0;
+	if(PLUS_MODE){
+		// Separators stay, even if data was one. They still split the keys
+		stop = child_index(bt, stop, data);
+		res = _btree_remove(bt->nodes[stop], data, degree, edge && stop == bt->size);
+	}else if(found){
+		_btree_remove_max(bt->nodes[stop], degree, bt->data + stop);
+	}else{
+		res = _btree_remove(bt->nodes[stop], data, degree, edge && stop == bt->size);
+	}
+	if(res < 0) return res;
+
+	// Only the rightmost child and its left sibling can be fixed with it
+	if(edge && stop + 1 >= bt->size && bt->nodes[stop]->size < BTREE_MIN(degree)) res = 1;
+
+	_btree_fix_underflow(bt, stop, degree);
+	return res;
+}
+
+/**	Remove data, and drop the root a level when it runs out of keys
+**/
+int btree_remove(struct btree *bt, const btree_data_t data){
+	if(bt == NULL) return -1;
+
+	int res = _btree_remove(bt->root, data, bt->degree, 1);
+	if(res < 0) return res;
+
+	bt->size--;
+	if(res) bt->last = NULL; // May have been merged away, found again on insert
+	if(bt->root->size == 0){
+		struct btreeNode *old = bt->root;
+		if(bt->last == old) bt->last = NULL;
+		bt->root = (old->nodes != NULL) ? old->nodes[0] : NULL;
+		free_btree_node(old);
+	}
+
+	return 0;
+}
+
+/**	Number of nodes to split m keys into, about per keys each. With lift
+	set, the key between each pair of nodes goes up to the parent instead of
+	into a node. Each node gets min to degree keys, unless it is the only one.
+**/
+static size_t bulk_nodes(size_t m, int lift, size_t per, size_t min, const unsigned short degree){
+	size_t cnt = (m + lift + per + lift - 1) / (per + lift);
+	while(cnt > 1 && (m - lift * (cnt-1)) / cnt < min) cnt--;
+	while((m - lift * (cnt-1) + cnt - 1) / cnt > degree) cnt++;
+
+	return cnt;
+}
+
+/**	Build one level at a time, left to right. Leaves take the keys in order;
+	a classic tree lifts the key after each leaf but the last, a B+ tree
+	copies up the first key of each leaf but the first. Each inner level is
+	then built from the keys lifted out of the level below, the same way as
+	classic leaves, until a level is a single node.
+	Nodes and lifted keys are written over the level below, which is safe
+	since a node is only stored after its keys and children are read.
+**/
+int btree_bulk_load(struct btree *bt, const btree_data_t *keys, size_t n, double fill){
+	if(bt == NULL || bt->degree < BTREE_MIN_DEGREE || bt->root != NULL || (keys == NULL && n) || !(fill > 0 && fill <= 1)){
 		return -1;
 	}
-	bt->root->nodes[1] = tmp;
 
-	// Copy back half data/nodes to new right node from original node, and set size
-	struct btreeNode *old = bt->root->nodes[0];
-	size_t back = old->size - res - 1;
-	//printf("Copying back half data starting at %d for %4lu units\n", res, back);
-	memcpy(tmp->data, old->data + res+1, (back) * sizeof(*old->data));
-	memcpy(tmp->nodes, old->nodes + res+1, (back+1) * sizeof(*old->nodes));
+	for(size_t i = 1;i < n;i++){
+		if(keys[i-1] >= keys[i]) return -1;
+	}
+	if(n == 0) return 0;
+
+	const size_t min = BTREE_MIN(bt->degree); // Same minimum btree_check holds nodes to
+	size_t per = fill * bt->degree + 0.5;
+	if(per < min) per = min;
+	if(per > bt->degree) per = bt->degree;
+
+	int lift = !PLUS_MODE;
+	size_t cnt = bulk_nodes(n, lift, per, min, bt->degree);
+	struct btreeNode **level = malloc(cnt * sizeof(*level));
+	btree_data_t *seps = malloc(cnt * sizeof(*seps));
+	if(level == NULL || seps == NULL){
+		free(level);
+		free(seps);
+		return -1;
+	}
 
-	// Update new and old node sizes
-	tmp->size = (old->size - 1)/2;
-	old->size /= 2; // Old size simply halved (rounding in favor)
+	const btree_data_t *src = keys;
+	size_t m = n; // Keys for this level
+	size_t kids = 0; // Nodes in the level below, 0 when building leaves
+	struct btreeNode *node;
+	for(;;){
+		size_t body = m - lift * (cnt-1); // Keys kept in this level's nodes
+		size_t pos = 0, used = 0; // Next key in src, next child in level
+		for(size_t i = 0;i < cnt;i++){
+			size_t k = body / cnt + (i < body % cnt);
+
+			node = create_btree_node(bt->degree, kids == 0);
+			if(node == NULL){
+				// Free what was built, and the children not yet given to a node
+				for(size_t j = 0;j < i;j++) _btree_destroy(level + j, bt->degree);
+				for(size_t j = used;j < kids;j++) _btree_destroy(level + j, bt->degree);
+				free(level);
+				free(seps);
+				return -1;
+			}
 
-	bt->size++; // Increment tree size
+			if(!lift && i > 0) seps[i-1] = src[pos];
+			memcpy(node->data, src + pos, k * sizeof(*src));
+			node->size = k;
+			pos += k;
+			if(lift && i+1 < cnt) seps[i] = src[pos++];
+
+			if(kids){
+				memcpy(node->nodes, level + used, (k+1) * sizeof(*level));
+				used += k+1;
+			}
+#ifdef BTREE_PLUS
+			else if(i > 0){
+				node->prev = level[i-1];
+				level[i-1]->next = node;
+			}
+#endif
+			level[i] = node;
+		}
+
+		if(cnt == 1) break;
+
+		// Next level up holds the lifted keys
+		kids = cnt;
+		m = cnt - 1;
+		src = seps;
+		lift = 1;
+		cnt = bulk_nodes(m, lift, per, min, bt->degree);
+	}
+
+	bt->root = level[0];
+	bt->size = n;
+	bt->last = rightmost_leaf(bt->root);
+
+	free(level);
+	free(seps);
 
 	return 0;
 }
@@ -258,25 +776,208 @@ int btree_insert(struct btree *bt, const btree_data_t data){
 int _btree_find(struct btreeNode const* bt, const unsigned short degree, const btree_data_t data){
 	if(bt == NULL) return 0;
 
-	int stop = 0;
-	while(stop < bt->size && data > bt->data[stop]){
-		stop++;
-	}
+	int stop = node_search(bt->data, bt->size, data);
 
-	if(bt->data[stop] == data){
+	if(bt->nodes == NULL){
+		return (stop < bt->size && bt->data[stop] == data);
+	}else if(!PLUS_MODE && stop < bt->size && bt->data[stop] == data){
 		return 1;
-	}else if(bt->nodes[stop] == NULL){
-		return 0;
 	}
 
 	// Recurse
-	return _btree_find(bt->nodes[stop], degree, data);
+	return _btree_find(bt->nodes[child_index(bt, stop, data)], degree, data);
 }
 
 int btree_find(struct btree const *bt, const btree_data_t data){
 	return _btree_find(bt->root, bt->degree, data);
 }
 
+/**	Check node against bounds (either may be NULL for unbounded), then
+	recurse. Nodes on the right edge (root included) may be under minimum,
+	as appends split them unevenly. Returns leaf depth below bt, or
+	negative if anything is off.
+**/
+int _btree_check(struct btreeNode const *bt, const unsigned short degree, int edge,
+	const btree_data_t *lo, const btree_data_t *hi, size_t *count){
+	if(bt->size > degree || (!edge && bt->size < BTREE_MIN(degree))) return -1;
+
+	// B+ subtrees hold [lo, hi), since separators are keys of the right side
+	for(int i = 0;i < bt->size;i++){
+		if((i > 0 && bt->data[i-1] >= bt->data[i]) || (lo != NULL && (bt->data[i] < *lo || (!PLUS_MODE && bt->data[i] == *lo)))
+			|| (hi != NULL && bt->data[i] >= *hi)){
+			return -1;
+		}
+	}
+
+	if(bt->nodes == NULL){
+		*count += bt->size;
+		return 0; // Leaf
+	}
+	if(!PLUS_MODE) *count += bt->size;
+
+	int depth = -1, res;
+	for(int i = 0;i <= bt->size;i++){
+		if(bt->nodes[i] == NULL) return -1;
+
+		res = _btree_check(bt->nodes[i], degree, edge && i == bt->size, (i > 0) ? bt->data + i - 1 : lo, (i < bt->size) ? bt->data + i : hi, count);
+		if(res < 0 || (depth >= 0 && res != depth)) return -1;
+		depth = res;
+	}
+
+	return depth + 1;
+}
+
+int btree_check(struct btree const *bt){
+	if(bt == NULL) return -1;
+	if(bt->root == NULL) return (bt->size != 0) ? -1 : 0;
+
+	size_t count = 0;
+	if(_btree_check(bt->root, bt->degree, 1, NULL, NULL, &count) < 0 || count != bt->size) return -1;
+	if(bt->last != NULL && bt->last != rightmost_leaf(bt->root)) return -1; // Stale append cache
+
+#ifdef BTREE_PLUS
+	// Leaf chain has to hold every key in order, with matching back links
+	struct btreeNode const *leaf = bt->root, *prev = NULL;
+	while(leaf->nodes != NULL) leaf = leaf->nodes[0];
+
+	count = 0;
+	for(;leaf != NULL;prev = leaf, leaf = leaf->next){
+		if(leaf->prev != prev || (prev != NULL && leaf->size && prev->size && prev->data[prev->size-1] >= leaf->data[0])){
+			return -1;
+		}
+		count += leaf->size;
+	}
+	if(count != bt->size) return -1;
+#endif
+
+	return 0;
+}
+
+/**	Prefetch every cache line of the used part of an array
+**/
+static inline void prefetch_range(const void *start, size_t bytes){
+	for(size_t off = 0;off < bytes;off += CACHE_LINE){
+		PREFETCH((const char *)start + off);
+	}
+}
+
+/**	Each search alternates between two stages, so it never touches memory it
+	has not prefetched a round earlier:
+		Stage 0: node struct is in cache, prefetch its data and child arrays
+		Stage 1: arrays are in cache, scan data and prefetch the child struct
+**/
+void btree_find_batch(struct btree const *bt, const btree_data_t *keys, size_t n, int *results){
+	if(bt == NULL) return;
+
+	struct btreeNode const *cur[BTREE_BATCH_WIDTH];
+	size_t idx[BTREE_BATCH_WIDTH];
+	int stage[BTREE_BATCH_WIDTH];
+	size_t next = 0;
+	int active = 0;
+
+	for(int i = 0;i < BTREE_BATCH_WIDTH;i++){
+		if(next < n){
+			cur[i] = bt->root;
+			idx[i] = next++;
+			stage[i] = 0;
+			active++;
+		}else{
+			idx[i] = n; // Lane unused
+		}
+	}
+
+	struct btreeNode const *node;
+	btree_data_t key;
+	int stop;
+	while(active > 0){
+		for(int i = 0;i < BTREE_BATCH_WIDTH;i++){
+			if(idx[i] == n) continue;
+
+			node = cur[i];
+			if(node != NULL && stage[i] == 0){
+				prefetch_range(node->data, (node->size + 1) * sizeof(*node->data));
+				if(node->nodes != NULL) prefetch_range(node->nodes, (node->size + 1) * sizeof(*node->nodes));
+				stage[i] = 1;
+				continue;
+			}
+
+			key = keys[idx[i]];
+			if(node != NULL){
+				stop = node_search(node->data, node->size, key);
+
+				if(node->nodes != NULL && (PLUS_MODE || stop == node->size || node->data[stop] != key)){
+					// Go down a level
+					cur[i] = node->nodes[child_index(node, stop, key)];
+					PREFETCH(cur[i]);
+					stage[i] = 0;
+					continue;
+				}
+			}
+
+			results[idx[i]] = (node != NULL && stop < node->size && node->data[stop] == key);
+			if(next < n){
+				cur[i] = bt->root;
+				idx[i] = next++;
+				stage[i] = 0;
+			}else{
+				idx[i] = n;
+				active--;
+			}
+		}
+	}
+}
+
+#ifdef BTREE_PLUS
+/**	Find the leaf for lo, then copy whole runs of each leaf, prefetching the
+	next leaf while the current one is copied.
+**/
+size_t btree_scan(struct btree const *bt, const btree_data_t lo, const btree_data_t hi, btree_data_t *out, size_t max){
+	if(bt == NULL || bt->root == NULL) return 0;
+
+	struct btreeNode const *node = bt->root;
+	while(node->nodes != NULL){
+		node = node->nodes[child_index(node, node_search(node->data, node->size, lo), lo)];
+	}
+
+	const size_t leaf_bytes = sizeof(*node) + (bt->degree + 1) * sizeof(*node->data);
+	size_t cnt = 0, run;
+	int start = node_search(node->data, node->size, lo), end;
+	while(node != NULL && cnt < max){
+		if(node->next != NULL) prefetch_range(node->next, leaf_bytes);
+
+		end = node_search(node->data, node->size, hi);
+		run = (end > start) ? end - start : 0;
+		if(run > max - cnt) run = max - cnt;
+
+		memcpy(out + cnt, node->data + start, run * sizeof(*out));
+		cnt += run;
+		if(end < node->size) break; // Reached hi
+
+		node = node->next;
+		start = 0;
+	}
+
+	return cnt;
+}
+#else
+/**	In-order walk of the keys in [lo, hi), skipping subtrees below lo
+**/
+size_t _btree_scan(struct btreeNode const *bt, const btree_data_t lo, const btree_data_t hi, btree_data_t *out, size_t max, size_t cnt){
+	for(int i = node_search(bt->data, bt->size, lo);;i++){
+		if(bt->nodes != NULL) cnt = _btree_scan(bt->nodes[i], lo, hi, out, max, cnt);
+		if(cnt >= max || i >= bt->size || bt->data[i] >= hi) return cnt;
+
+		out[cnt++] = bt->data[i];
+	}
+}
+
+size_t btree_scan(struct btree const *bt, const btree_data_t lo, const btree_data_t hi, btree_data_t *out, size_t max){
+	if(bt == NULL || bt->root == NULL || max == 0) return 0;
+
+	return _btree_scan(bt->root, lo, hi, out, max, 0);
+}
+#endif
+
 void _btree_print(struct btreeNode *const bt, const unsigned short degree){
 	if(bt == NULL) return;
 
@@ -287,7 +988,7 @@ void _btree_print(struct btreeNode *const bt, const unsigned short degree){
 	printf("]\n");
 
 	// Recurse print
-	for(int i = 0;i <= bt->size;i++){
+	for(int i = 0;i <= bt->size && bt->nodes != NULL;i++){
 		printf("%p Node %3d:\n", bt, i);
 		_btree_print(bt->nodes[i], degree);
 		//printf("------\n");
@@ -7,24 +7,94 @@
 
 typedef long btree_data_t;
 
+/**	Build with BTREE_PLUS for a B+ tree: every key lives in a leaf, inner
+	nodes only hold separators, and leaves are chained for btree_scan.
+	Same functions either way.
+**/
+
+/**	Degree 1 splits into empty nodes and can't borrow or merge on remove
+	(a single key has no minimum to keep), in either mode.
+**/
+#define BTREE_MIN_DEGREE 2
+
+#define BTREE_BATCH_WIDTH 16 // Searches in flight for batched find
+
+/**	In-node key search. The default is picked at load time from
+	BTREE_SEARCH_DEFAULT (AUTO unless set at build time), and AUTO takes the
+	widest vector form the CPU supports, falling back to branchless binary.
+**/
+enum btree_search{
+	BTREE_SEARCH_AUTO,
+	BTREE_SEARCH_LINEAR,	// Scalar loop
+	BTREE_SEARCH_BINARY,	// Branchless binary search
+	BTREE_SEARCH_SSE42,	// 2 keys per compare, then popcount
+	BTREE_SEARCH_AVX2	// 4 keys per compare, then popcount
+};
+
 // This is public struct, which is used to hold the degree (primarily) and total size
 struct btree{
 	unsigned short degree; // How big arrays are
 	size_t size; // Size of entire tree
 	struct btreeNode *root;
+	struct btreeNode *last; // Rightmost leaf, for appends. NULL until found
 };
 
 
 void btree_destroy(struct btree *);
 
-/**	Public function, with private inside c file
+/**	Public function, with private inside c file. Returns 0 if inserted,
+	nonzero if present, out of memory or degree < BTREE_MIN_DEGREE. Nodes
+	for any splits are allocated first, so running out of memory leaves the
+	tree unchanged.
+	A key larger than any in the tree goes straight into the cached
+	rightmost leaf, and splits from appends leave the left node full, so
+	increasing keys pack densely.
 **/
 int btree_insert(struct btree *, const btree_data_t);
 
+/**	Builds an empty tree from n strictly increasing keys in one bottom-up
+	pass, packing nodes left to right about fill (0 to 1] full. Nodes never
+	go under half full, so fill below 0.5 acts as 0.5.
+	Returns 0 if loaded, nonzero if the tree wasn't empty, keys are out of
+	order, degree < BTREE_MIN_DEGREE or memory ran out (tree is left empty).
+**/
+int btree_bulk_load(struct btree *, const btree_data_t *keys, size_t n, double fill);
+
+/**	Removes data, merging or borrowing to keep nodes at least half full
+	(except along the right edge, which appends can leave under full).
+	Returns 0 if removed, nonzero if not found.
+**/
+int btree_remove(struct btree *, const btree_data_t);
+
 /**	Returns nonzero if data exists in tree.
 **/
 int btree_find(struct btree const *bt, const btree_data_t);
 
+/**	Copies up to max keys in [lo, hi) into out, in order. Returns count.
+	Fastest in B+ mode, where leaves are read in order along their chain.
+**/
+size_t btree_scan(struct btree const *bt, const btree_data_t lo, const btree_data_t hi, btree_data_t *out, size_t max);
+
+/**	Looks up n keys at once, setting results[i] nonzero if keys[i] exists.
+	Many searches are advanced together so their cache misses overlap.
+**/
+void btree_find_batch(struct btree const *bt, const btree_data_t *keys, size_t n, int *results);
+
 void btree_print(struct btree const *);
 
+/**	Select in-node search for all trees. Returns 0 if set, nonzero if the
+	CPU (or build) doesn't support it.
+**/
+int btree_set_search(enum btree_search);
+
+/**	Number of keys in sorted keys[0, n) less than key, with the selected
+	in-node search. For other node layouts built on the same keys.
+**/
+int btree_node_search(const btree_data_t *keys, int n, btree_data_t key);
+
+/**	Returns 0 if keys are in order, all leaves are at the same depth, node
+	sizes are in range and bt->size matches. Nonzero otherwise.
+**/
+int btree_check(struct btree const *);
+
 #endif
@@ -0,0 +1,318 @@
+#include<sched.h>
+#include"btreec.h"
+
+#define LOCKED 1
+#define RETRY 1
+#define CACHE_LINE 64
+#define SPINS 64 // Busy waits on a locked node before yielding the CPU
+
+/**	Version latch, same idea as a seqlock. Reads done between read_lock
+	and a successful still() saw a consistent node; anything else may have
+	been torn and must not be trusted (only dereferenced, since nodes are
+	never freed while the tree is in use).
+**/
+static inline uint64_t read_lock(_Atomic uint64_t *ver){
+	uint64_t v;
+	for(int spin = 0;(v = atomic_load_explicit(ver, memory_order_acquire)) & LOCKED;spin++){
+		if(spin >= SPINS) sched_yield();
+	}
+
+	return v;
+}
+
+static inline int still(_Atomic uint64_t *ver, uint64_t v){
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(ver, memory_order_relaxed) == v;
+}
+
+/**	Lock, if nobody has changed the node since it was read at v
+**/
+static inline int upgrade(_Atomic uint64_t *ver, uint64_t v){
+	if(!atomic_compare_exchange_strong_explicit(ver, &v, v | LOCKED, memory_order_acquire, memory_order_relaxed)){
+		return 0;
+	}
+	atomic_thread_fence(memory_order_release); // Lock is seen before any change
+
+	return 1;
+}
+
+static inline void unlock(_Atomic uint64_t *ver){
+	atomic_fetch_add_explicit(ver, LOCKED, memory_order_release);
+}
+
+// Unlock without a change, so readers that saw v don't restart
+static inline void unlock_unchanged(_Atomic uint64_t *ver, uint64_t v){
+	atomic_store_explicit(ver, v, memory_order_release);
+}
+
+/**	Allocation helper. Block is rounded up to whole cache lines
+**/
+static struct btreecNode *create_btreec_node(unsigned short degree, int leaf){
+	size_t keys = sizeof(struct btreecNode) + degree * sizeof(btree_data_t);
+	size_t bytes = keys + ((leaf) ? 0 : (degree+1) * sizeof(_Atomic(struct btreecNode *)));
+	bytes = (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+
+	struct btreecNode *ret = aligned_alloc(CACHE_LINE, bytes);
+	if(ret == NULL){
+		return NULL;
+	}
+
+	atomic_init(&ret->version, 0);
+	atomic_init(&ret->size, 0);
+	ret->nodes = NULL;
+	if(!leaf){
+		ret->nodes = (_Atomic(struct btreecNode *) *)((char *)ret + keys);
+		for(int i = 0;i <= degree;i++) atomic_init(ret->nodes + i, NULL);
+	}
+
+	return ret;
+}
+
+int btreec_init(struct btreec *t, unsigned short degree){
+	if(t == NULL || degree < 3) return -1;
+
+	struct btreecNode *root = create_btreec_node(degree, 1);
+	if(root == NULL) return -1;
+
+	atomic_init(&t->root, root);
+	atomic_init(&t->version, 0);
+	t->degree = degree;
+	atomic_init(&t->size, 0);
+
+	return 0;
+}
+
+/**	Child to descend into. A separator equal to data sends it right
+**/
+static inline int child_index(struct btreecNode const *node, int n, const btree_data_t data){
+	int stop = btree_node_search(node->data, n, data);
+
+	return stop + (stop < n && node->data[stop] == data);
+}
+
+/**	Descend to the leaf that would hold data, returning it and the version
+	it was read at. Returns NULL if something changed on the way.
+**/
+static struct btreecNode *find_leaf(struct btreec *t, const btree_data_t data, uint64_t *v){
+	uint64_t rv = read_lock(&t->version);
+	struct btreecNode *node = atomic_load_explicit(&t->root, memory_order_acquire);
+	uint64_t nv = read_lock(&node->version);
+	if(!still(&t->version, rv)) return NULL;
+
+	struct btreecNode *child;
+	uint64_t cv;
+	int n;
+	while(node->nodes != NULL){
+		n = atomic_load_explicit(&node->size, memory_order_relaxed);
+		child = atomic_load_explicit(node->nodes + child_index(node, n, data), memory_order_relaxed);
+		if(child == NULL) return NULL; // Read mid change
+
+		cv = read_lock(&child->version);
+		if(!still(&node->version, nv)) return NULL;
+
+		node = child;
+		nv = cv;
+	}
+
+	*v = nv;
+	return node;
+}
+
+int btreec_find(struct btreec *t, const btree_data_t data){
+	if(t == NULL) return 0;
+
+	struct btreecNode *leaf;
+	uint64_t v;
+	int n, stop, found;
+	for(;;){
+		leaf = find_leaf(t, data, &v);
+		if(leaf == NULL) continue;
+
+		n = atomic_load_explicit(&leaf->size, memory_order_relaxed);
+		stop = btree_node_search(leaf->data, n, data);
+		found = (stop < n && leaf->data[stop] == data);
+		if(still(&leaf->version, v)) return found;
+	}
+}
+
+/**	Split full node in two, adding the separator to parent (or a new root
+	when parent is NULL). Both are locked by the caller, and parent has room
+	since it was not full when the caller passed it.
+	Returns 0 if split, nonzero if out of memory (nothing is changed)
+**/
+static int split(struct btreec *t, struct btreecNode *parent, struct btreecNode *node){
+	const int n = t->degree, mid = n / 2;
+	struct btreecNode *right = create_btreec_node(t->degree, node->nodes == NULL);
+	struct btreecNode *root = (parent == NULL) ? create_btreec_node(t->degree, 0) : NULL;
+	if(right == NULL || (parent == NULL && root == NULL)){
+		free(right);
+		free(root);
+		return -1;
+	}
+
+	// Leaves copy the first key of the right half up, inner nodes move the middle key up
+	btree_data_t sep;
+	if(node->nodes == NULL){
+		memcpy(right->data, node->data + mid, (n - mid) * sizeof(*node->data));
+		atomic_store_explicit(&right->size, n - mid, memory_order_relaxed);
+		sep = right->data[0];
+	}else{
+		memcpy(right->data, node->data + mid + 1, (n - mid - 1) * sizeof(*node->data));
+		for(int i = mid + 1;i <= n;i++){
+			atomic_store_explicit(right->nodes + (i - mid - 1), atomic_load_explicit(node->nodes + i, memory_order_relaxed),
+				memory_order_relaxed);
+		}
+		atomic_store_explicit(&right->size, n - mid - 1, memory_order_relaxed);
+		sep = node->data[mid];
+	}
+	atomic_store_explicit(&node->size, mid, memory_order_relaxed);
+
+	if(parent == NULL){
+		root->data[0] = sep;
+		atomic_store_explicit(&root->size, 1, memory_order_relaxed);
+		atomic_store_explicit(root->nodes, node, memory_order_relaxed);
+		atomic_store_explicit(root->nodes + 1, right, memory_order_relaxed);
+		atomic_store_explicit(&t->root, root, memory_order_release);
+		return 0;
+	}
+
+	// Shift separators and children after node right by one
+	int size = atomic_load_explicit(&parent->size, memory_order_relaxed);
+	int i = btree_node_search(parent->data, size, sep);
+	memmove(parent->data + i + 1, parent->data + i, (size - i) * sizeof(*parent->data));
+	for(int j = size + 1;j > i + 1;j--){
+		atomic_store_explicit(parent->nodes + j, atomic_load_explicit(parent->nodes + j - 1, memory_order_relaxed),
+			memory_order_relaxed);
+	}
+	parent->data[i] = sep;
+	atomic_store_explicit(parent->nodes + i + 1, right, memory_order_relaxed);
+	atomic_store_explicit(&parent->size, size + 1, memory_order_relaxed);
+
+	return 0;
+}
+
+/**	One try at an insert. Any full node met on the way down is split
+	first, then the insert starts over from the root.
+	Returns 0 if inserted, negative if present or out of memory, RETRY if
+	something changed underneath
+**/
+static int attempt_insert(struct btreec *t, const btree_data_t data){
+	// Lock over the link to node: the root pointer, then each parent
+	_Atomic uint64_t *pver = &t->version;
+	struct btreecNode *parent = NULL;
+	uint64_t pv = read_lock(pver);
+
+	struct btreecNode *node = atomic_load_explicit(&t->root, memory_order_acquire);
+	uint64_t v = read_lock(&node->version);
+	if(!still(pver, pv)) return RETRY;
+
+	struct btreecNode *child;
+	uint64_t cv;
+	int n, stop;
+	for(;;){
+		n = atomic_load_explicit(&node->size, memory_order_relaxed);
+		if(n == t->degree){
+			if(!upgrade(pver, pv)) return RETRY;
+			if(!upgrade(&node->version, v)){
+				unlock_unchanged(pver, pv);
+				return RETRY;
+			}
+
+			int res = split(t, parent, node);
+			if(res){
+				unlock_unchanged(&node->version, v);
+				unlock_unchanged(pver, pv);
+				return -1;
+			}
+			unlock(&node->version);
+			unlock(pver);
+
+			return RETRY;
+		}
+		if(node->nodes == NULL) break;
+
+		child = atomic_load_explicit(node->nodes + child_index(node, n, data), memory_order_relaxed);
+		if(child == NULL) return RETRY;
+
+		cv = read_lock(&child->version);
+		if(!still(&node->version, v)) return RETRY;
+
+		parent = node;
+		pver = &node->version;
+		pv = v;
+		node = child;
+		v = cv;
+	}
+
+	// Leaf with room. Size read above is still good once locked at v
+	if(!upgrade(&node->version, v)) return RETRY;
+
+	stop = btree_node_search(node->data, n, data);
+	if(stop < n && node->data[stop] == data){
+		unlock_unchanged(&node->version, v);
+		return -1;
+	}
+	memmove(node->data + stop + 1, node->data + stop, (n - stop) * sizeof(*node->data));
+	node->data[stop] = data;
+	atomic_store_explicit(&node->size, n + 1, memory_order_relaxed);
+	unlock(&node->version);
+
+	atomic_fetch_add(&t->size, 1);
+	return 0;
+}
+
+int btreec_insert(struct btreec *t, const btree_data_t data){
+	if(t == NULL) return -1;
+
+	int res;
+	while((res = attempt_insert(t, data)) == RETRY);
+
+	return res;
+}
+
+/**	Take the key out of its leaf, with only the leaf locked
+**/
+int btreec_remove(struct btreec *t, const btree_data_t data){
+	if(t == NULL) return -1;
+
+	struct btreecNode *leaf;
+	uint64_t v;
+	int n, stop;
+	for(;;){
+		leaf = find_leaf(t, data, &v);
+		if(leaf == NULL || !upgrade(&leaf->version, v)) continue;
+
+		n = atomic_load_explicit(&leaf->size, memory_order_relaxed);
+		stop = btree_node_search(leaf->data, n, data);
+		if(stop >= n || leaf->data[stop] != data){
+			unlock_unchanged(&leaf->version, v);
+			return -1;
+		}
+
+		memmove(leaf->data + stop, leaf->data + stop + 1, (n - stop - 1) * sizeof(*leaf->data));
+		atomic_store_explicit(&leaf->size, n - 1, memory_order_relaxed);
+		unlock(&leaf->version);
+
+		atomic_fetch_sub(&t->size, 1);
+		return 0;
+	}
+}
+
+static void _btreec_destroy(struct btreecNode *node){
+	if(node->nodes != NULL){
+		int n = atomic_load(&node->size);
+		for(int i = 0;i <= n;i++){
+			_btreec_destroy(atomic_load(node->nodes + i));
+		}
+	}
+
+	free(node);
+}
+
+void btreec_destroy(struct btreec *t){
+	if(t == NULL || atomic_load(&t->root) == NULL) return;
+
+	_btreec_destroy(atomic_load(&t->root));
+	atomic_store(&t->root, NULL);
+	atomic_store(&t->size, 0);
+}
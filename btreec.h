@@ -0,0 +1,56 @@
+#ifndef BTREEC_H
+#define BTREEC_H
+
+#include<stdint.h>
+#include<stdatomic.h>
+#include"btree.h"
+
+/**	Concurrent B+ tree with optimistic lock coupling. Every node has a
+	version that writers lock by making it odd and unlock by making it even
+	again (one higher than before). Readers never write anything shared:
+	they note each version on the way down and restart if one has changed
+	by the time they move on.
+	Keys are all in leaves, and inner keys are separators (the smallest key
+	of the subtree to their right), same as BTREE_PLUS.
+**/
+struct btreecNode{
+	_Atomic uint64_t version; // Change count << 1 | locked
+	atomic_int size;
+	_Atomic(struct btreecNode *) *nodes; // Child array in the same block, NULL for leaves. Never changes
+	btree_data_t data[]; // degree keys
+};
+
+/**	Tree handle. The root pointer has its own version, locked to grow the
+	tree a level.
+	Writers split full nodes on the way down, so a split only ever has to
+	lock the node and its parent. Removes leave leaves under full (or empty)
+	rather than merge, so nodes are only freed by btreec_destroy and
+	readers never need to guard against reading freed memory.
+**/
+struct btreec{
+	_Atomic(struct btreecNode *) root;
+	_Atomic uint64_t version;
+	unsigned short degree; // Max keys per node, at least 3
+	atomic_size_t size;
+};
+
+/**	Returns 0 if initialized, nonzero otherwise (degree < 3, or no memory)
+**/
+int btreec_init(struct btreec *, unsigned short degree);
+
+/**	Safe to call from any number of threads at once.
+	Returns 0 if inserted/removed, nonzero if present/missing or no memory.
+**/
+int btreec_insert(struct btreec *, const btree_data_t);
+int btreec_remove(struct btreec *, const btree_data_t);
+
+/**	Returns nonzero if data exists in tree. Lock free unless it meets a
+	node a writer holds, which it waits out.
+**/
+int btreec_find(struct btreec *, const btree_data_t);
+
+/**	Free up entire tree. No other thread may be using it
+**/
+void btreec_destroy(struct btreec *);
+
+#endif
@@ -0,0 +1,409 @@
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/stat.h>
+#include"btreedisk.h"
+
+#define NO_FRAME ((size_t)-1)
+
+// Child page numbers follow the keys
+static inline uint64_t *page_nodes(struct btree_disk const *bd, struct btree_page *page){
+	return (uint64_t *)(page->data + bd->degree + 1);
+}
+
+static inline size_t frame_of(struct btree_disk const *bd, struct btree_page const *page){
+	return ((unsigned char *)page - bd->pool.bufs) / bd->page_size;
+}
+
+static inline struct btree_page *frame_page(struct btree_disk const *bd, size_t f){
+	return (struct btree_page *)(bd->pool.bufs + f * bd->page_size);
+}
+
+/**	Move frame to the newest end of the LRU list
+**/
+static void lru_touch(struct btree_pool *pool, size_t f){
+	struct btree_frame *fr = pool->frames;
+	if(pool->newest == f) return;
+
+	// Unlink, if linked
+	if(fr[f].older != NO_FRAME) fr[fr[f].older].newer = fr[f].newer;
+	if(fr[f].newer != NO_FRAME) fr[fr[f].newer].older = fr[f].older;
+	if(pool->oldest == f) pool->oldest = fr[f].newer;
+
+	fr[f].older = pool->newest;
+	fr[f].newer = NO_FRAME;
+	if(pool->newest != NO_FRAME) fr[pool->newest].newer = f;
+	pool->newest = f;
+	if(pool->oldest == NO_FRAME) pool->oldest = f;
+}
+
+static int write_frame(struct btree_disk *bd, size_t f){
+	struct btree_frame *fr = bd->pool.frames + f;
+	if(!fr->dirty) return 0;
+
+	if(pwrite(bd->fd, frame_page(bd, f), bd->page_size, fr->page * bd->page_size) != (ssize_t)bd->page_size) return -1;
+	fr->dirty = 0;
+	bd->pool.writes++;
+
+	return 0;
+}
+
+/**	Pick a frame to reuse. Never used frames go first. CLOCK sweeps the
+	hand, clearing reference bits until it finds an unpinned frame without
+	one; two full turns means everything is pinned. LRU takes the oldest
+	unpinned frame. Returns frame, or NO_FRAME if all are pinned.
+**/
+static size_t pool_victim(struct btree_pool *pool){
+	if(pool->used < pool->count) return pool->used++;
+
+	size_t f;
+	if(pool->policy == BTREE_EVICT_CLOCK){
+		for(size_t i = 0;i < 2 * pool->count;i++){
+			f = pool->hand;
+			pool->hand = (pool->hand + 1) % pool->count;
+
+			if(pool->frames[f].pins) continue;
+			if(pool->frames[f].ref){
+				pool->frames[f].ref = 0;
+				continue;
+			}
+			return f;
+		}
+		return NO_FRAME;
+	}
+
+	for(f = pool->oldest;f != NO_FRAME;f = pool->frames[f].newer){
+		if(pool->frames[f].pins == 0) return f;
+	}
+
+	return NO_FRAME;
+}
+
+/**	Pin page in a frame, reading it unless fresh (a new page, which starts
+	zeroed and dirty). Pinned frames are never evicted.
+	Returns page, or NULL if every frame is pinned or I/O failed.
+**/
+static struct btree_page *pool_pin(struct btree_disk *bd, uint64_t id, int fresh){
+	struct btree_pool *pool = &bd->pool;
+
+	// Grow page table to cover id
+	if(id >= pool->where_len){
+		uint64_t len = (pool->where_len) ? pool->where_len : 1024;
+		while(len <= id) len *= 2;
+
+		uint32_t *tmp = realloc(pool->where, len * sizeof(*tmp));
+		if(tmp == NULL) return NULL;
+		memset(tmp + pool->where_len, 0, (len - pool->where_len) * sizeof(*tmp));
+		pool->where = tmp;
+		pool->where_len = len;
+	}
+
+	size_t f;
+	if(pool->where[id]){
+		f = pool->where[id] - 1;
+		pool->hits++;
+	}else{
+		f = pool_victim(pool);
+		if(f == NO_FRAME) return NULL;
+
+		struct btree_frame *fr = pool->frames + f;
+		if(fr->page){
+			if(write_frame(bd, f)) return NULL;
+			pool->where[fr->page] = 0;
+			fr->page = 0;
+		}
+
+		if(fresh){
+			memset(frame_page(bd, f), 0, bd->page_size);
+			fr->dirty = 1;
+		}else{
+			if(pread(bd->fd, frame_page(bd, f), bd->page_size, id * bd->page_size) != (ssize_t)bd->page_size) return NULL;
+			pool->reads++;
+		}
+		pool->misses++;
+
+		fr->page = id;
+		pool->where[id] = f + 1;
+	}
+
+	pool->frames[f].pins++;
+	pool->frames[f].ref = 1;
+	if(pool->policy == BTREE_EVICT_LRU) lru_touch(pool, f);
+
+	return frame_page(bd, f);
+}
+
+static void pool_unpin(struct btree_disk *bd, struct btree_page *page, int dirty){
+	struct btree_frame *fr = bd->pool.frames + frame_of(bd, page);
+
+	fr->dirty |= dirty;
+	fr->pins--;
+}
+
+/**	Pin a new, empty page at the end of the file
+**/
+static struct btree_page *create_btree_page(struct btree_disk *bd, int leaf, uint64_t *id){
+	struct btree_page *page = pool_pin(bd, bd->pages, 1);
+	if(page == NULL) return NULL;
+
+	*id = bd->pages++;
+	page->leaf = leaf;
+
+	return page;
+}
+
+static int write_header(struct btree_disk *bd){
+	struct btree_disk_header head = {0};
+	head.magic = BTREE_DISK_MAGIC;
+	head.version = BTREE_DISK_VERSION;
+	head.data_size = sizeof(btree_data_t);
+	head.page_size = bd->page_size;
+	head.root = bd->root;
+	head.pages = bd->pages;
+	head.size = bd->size;
+
+	return (pwrite(bd->fd, &head, sizeof(head), 0) != sizeof(head));
+}
+
+int btree_disk_open(struct btree_disk *bd, const char *path, size_t page_size, size_t pool_bytes, enum btree_evict policy){
+	if(bd == NULL || path == NULL || (policy != BTREE_EVICT_CLOCK && policy != BTREE_EVICT_LRU)) return -1;
+
+	bd->fd = open(path, O_RDWR | O_CREAT, 0644);
+	if(bd->fd < 0) return -1; // fd is -1 after any failure
+
+	struct stat st;
+	if(fstat(bd->fd, &st)){
+		close(bd->fd);
+		bd->fd = -1;
+		return -1;
+	}
+
+	if(st.st_size > 0){
+		struct btree_disk_header head;
+		if(pread(bd->fd, &head, sizeof(head), 0) != sizeof(head) || head.magic != BTREE_DISK_MAGIC
+			|| head.version != BTREE_DISK_VERSION || head.data_size != sizeof(btree_data_t)){
+			close(bd->fd);
+			bd->fd = -1;
+			return -1;
+		}
+		page_size = head.page_size;
+		bd->root = head.root;
+		bd->pages = head.pages;
+		bd->size = head.size;
+	}else{
+		bd->root = 0;
+		bd->pages = 1;
+		bd->size = 0;
+	}
+
+	if(page_size < BTREE_DISK_MIN_PAGE || page_size > BTREE_DISK_MAX_PAGE || (page_size & (page_size - 1))
+		|| bd->root >= bd->pages){
+		close(bd->fd);
+		bd->fd = -1;
+		return -1;
+	}
+	bd->page_size = page_size;
+
+	// Header, degree+1 keys, degree+2 children
+	bd->degree = (page_size - sizeof(struct btree_page) - 2 * sizeof(uint64_t)) / (sizeof(btree_data_t) + sizeof(uint64_t));
+
+	struct btree_pool *pool = &bd->pool;
+	memset(pool, 0, sizeof(*pool));
+	pool->count = pool_bytes / page_size;
+	if(pool->count < BTREE_DISK_MIN_FRAMES) pool->count = BTREE_DISK_MIN_FRAMES;
+	pool->policy = policy;
+	pool->newest = pool->oldest = NO_FRAME;
+
+	pool->frames = malloc(pool->count * sizeof(*pool->frames));
+	pool->bufs = aligned_alloc(BTREE_DISK_MIN_PAGE, pool->count * page_size);
+	if(pool->frames == NULL || pool->bufs == NULL || (st.st_size == 0 && write_header(bd))){
+		free(pool->frames);
+		free(pool->bufs);
+		close(bd->fd);
+		bd->fd = -1;
+		return -1;
+	}
+	for(size_t f = 0;f < pool->count;f++){
+		pool->frames[f] = (struct btree_frame){0};
+		pool->frames[f].newer = pool->frames[f].older = NO_FRAME;
+	}
+
+	return 0;
+}
+
+/**	Move keys (and children) after index res of an overflowing page into a
+	new right page, leaving res keys in old. Key res is what gets lifted.
+	Returns new right page pinned, NULL on failure (old is not changed)
+**/
+static struct btree_page *_btree_disk_split(struct btree_disk *bd, struct btree_page *old, int res, uint64_t *id){
+	struct btree_page *tmp = create_btree_page(bd, old->leaf, id);
+	if(tmp == NULL) return NULL;
+
+	size_t back = old->size - res - 1;
+	memcpy(tmp->data, old->data + (res + 1), back * sizeof(*old->data));
+	if(!old->leaf) memcpy(page_nodes(bd, tmp), page_nodes(bd, old) + (res + 1), (back+1) * sizeof(uint64_t));
+
+	tmp->size = back;
+	old->size = res;
+
+	return tmp;
+}
+
+/**	Same as _btree_insert, with children pinned while they are worked on
+	lift -- data that needs to be pushed up to parent
+	Returns negative for error, strictly positive (> 0) for lift data
+**/
+static int _btree_disk_insert(struct btree_disk *bd, struct btree_page *bt, const btree_data_t data, btree_data_t *lift){
+	int res = 0;
+	int stop = btree_node_search(bt->data, bt->size, data);
+
+	if(stop < bt->size && data == bt->data[stop]){
+		return -1;
+	}
+
+	if(bt->leaf){
+		// Insert here at leaf
+		memmove(bt->data + stop + 1, bt->data + stop, (bt->size-stop) * sizeof(*bt->data));
+		bt->data[stop] = data;
+
+		bt->size++;
+	}else{
+		uint64_t *nodes = page_nodes(bd, bt);
+		struct btree_page *child = pool_pin(bd, nodes[stop], 0);
+		if(child == NULL) return -1;
+
+		res = _btree_disk_insert(bd, child, data, lift);
+		if(res > 0){
+			// Cleave child, shifting data and nodes right for the new right page
+			uint64_t id;
+			struct btree_page *tmp = _btree_disk_split(bd, child, res, &id);
+			if(tmp == NULL){
+				pool_unpin(bd, child, 1);
+				return -1;
+			}
+			memmove(bt->data + stop + 1, bt->data + stop, (bt->size-stop) * sizeof(*bt->data));
+			memmove(nodes + stop + 2, nodes + stop + 1, (bt->size-stop) * sizeof(*nodes));
+
+			bt->data[stop] = *lift;
+			nodes[stop+1] = id;
+			bt->size++;
+
+			pool_unpin(bd, tmp, 1);
+			res = 0;
+		}
+		pool_unpin(bd, child, res == 0);
+		if(res < 0) return res;
+	}
+
+	// Check if page full ==> push median value up
+	if(bt->size > bd->degree){
+		*lift = bt->data[bt->size / 2];
+		res = bt->size / 2;
+	}
+
+	return res;
+}
+
+int btree_disk_insert(struct btree_disk *bd, const btree_data_t data){
+	if(bd == NULL) return -1;
+
+	uint64_t id;
+	struct btree_page *root;
+	if(bd->root == 0){
+		root = create_btree_page(bd, 1, &id);
+		if(root == NULL) return -1;
+
+		root->size = 1;
+		root->data[0] = data;
+		pool_unpin(bd, root, 1);
+
+		bd->root = id;
+		bd->size = 1;
+		return 0;
+	}
+
+	struct btree_page *old = pool_pin(bd, bd->root, 0);
+	if(old == NULL) return -1;
+
+	btree_data_t up;
+	int res = _btree_disk_insert(bd, old, data, &up);
+	if(res <= 0){
+		pool_unpin(bd, old, res == 0);
+		if(res == 0) bd->size++;
+		return res;
+	}
+
+	// New root above the old one and its new right sibling
+	struct btree_page *tmp;
+	uint64_t right;
+	root = create_btree_page(bd, 0, &id);
+	tmp = (root != NULL) ? _btree_disk_split(bd, old, res, &right) : NULL;
+	if(tmp == NULL){
+		if(root != NULL) pool_unpin(bd, root, 1);
+		pool_unpin(bd, old, 1);
+		return -1;
+	}
+
+	root->data[0] = up;
+	root->size = 1;
+	page_nodes(bd, root)[0] = bd->root;
+	page_nodes(bd, root)[1] = right;
+	bd->root = id;
+
+	pool_unpin(bd, tmp, 1);
+	pool_unpin(bd, root, 1);
+	pool_unpin(bd, old, 1);
+
+	bd->size++;
+
+	return 0;
+}
+
+/**	Walk down with only one page pinned at a time
+**/
+int btree_disk_find(struct btree_disk *bd, const btree_data_t data){
+	if(bd == NULL) return 0;
+
+	uint64_t id = bd->root;
+	struct btree_page *page;
+	int stop, found;
+	while(id){
+		page = pool_pin(bd, id, 0);
+		if(page == NULL) return 0;
+
+		stop = btree_node_search(page->data, page->size, data);
+		found = (stop < page->size && page->data[stop] == data);
+		id = (found || page->leaf) ? 0 : page_nodes(bd, page)[stop];
+
+		pool_unpin(bd, page, 0);
+		if(found) return 1;
+	}
+
+	return 0;
+}
+
+int btree_disk_flush(struct btree_disk *bd){
+	if(bd == NULL) return -1;
+
+	int ret = 0;
+	for(size_t f = 0;f < bd->pool.used;f++){
+		if(bd->pool.frames[f].page && write_frame(bd, f)) ret = -1;
+	}
+	if(write_header(bd) || fsync(bd->fd)) ret = -1;
+
+	return ret;
+}
+
+int btree_disk_close(struct btree_disk *bd){
+	if(bd == NULL) return -1;
+
+	int ret = btree_disk_flush(bd);
+	if(close(bd->fd)) ret = -1;
+
+	free(bd->pool.frames);
+	free(bd->pool.bufs);
+	free(bd->pool.where);
+	memset(&bd->pool, 0, sizeof(bd->pool));
+	bd->fd = -1;
+
+	return ret;
+}
@@ -0,0 +1,99 @@
+#ifndef BTREEDISK_H
+#define BTREEDISK_H
+
+#include<stdint.h>
+#include"btree.h"
+
+#define BTREE_DISK_MAGIC 0x314B5349445442ULL // "BTDISK1" little endian
+#define BTREE_DISK_VERSION 1
+#define BTREE_DISK_MIN_PAGE 4096
+#define BTREE_DISK_MAX_PAGE 65536
+#define BTREE_DISK_MIN_FRAMES 16 // Smallest pool. An insert pins the whole path, plus two
+
+/**	File is page 0 (this header), then one node per page. Nodes refer to
+	each other by page number, and page 0 doubles as "no page". Integers are
+	in host byte order.
+**/
+struct btree_disk_header{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t data_size; // sizeof(btree_data_t) of the writer
+	uint64_t page_size;
+	uint64_t root;
+	uint64_t pages; // Pages in use, including this one
+	uint64_t size; // Keys in tree
+};
+
+/**	Same layout as an in-memory node: size, then degree+1 keys (one spare
+	for overflow before a split), then degree+2 child page numbers for inner
+	nodes. Degree is whatever fits in the page.
+**/
+struct btree_page{
+	uint32_t size;
+	uint32_t leaf;
+	btree_data_t data[];
+};
+
+enum btree_evict{
+	BTREE_EVICT_CLOCK,	// Second chance, one reference bit per frame
+	BTREE_EVICT_LRU	// Least recently unpinned first
+};
+
+struct btree_frame{
+	uint64_t page; // Page held, 0 if none
+	unsigned pins;
+	unsigned char ref; // CLOCK reference bit
+	unsigned char dirty;
+	size_t newer, older; // LRU list, by frame index
+};
+
+/**	Fixed set of page sized frames. Pages are found through a table indexed
+	by page number (4 bytes per page in the file), so lookups never search.
+**/
+struct btree_pool{
+	struct btree_frame *frames;
+	unsigned char *bufs; // count * page_size bytes
+	size_t count;
+	size_t used; // Frames handed out so far, the rest have never held a page
+	uint32_t *where; // Frame index + 1 holding each page, 0 if not cached
+	uint64_t where_len;
+	enum btree_evict policy;
+	size_t hand; // CLOCK hand
+	size_t newest, oldest; // LRU ends
+	size_t hits, misses, reads, writes;
+};
+
+struct btree_disk{
+	int fd;
+	size_t page_size;
+	unsigned short degree;
+	uint64_t root;
+	uint64_t pages;
+	size_t size;
+	struct btree_pool pool;
+};
+
+/**	Open path, creating it with page_size (power of 2, 4 to 64 KiB) pages if
+	empty. An existing file keeps its own page size. The pool gets
+	pool_bytes of frames, at least BTREE_DISK_MIN_FRAMES.
+	Returns 0 if opened, nonzero otherwise.
+**/
+int btree_disk_open(struct btree_disk *, const char *path, size_t page_size, size_t pool_bytes, enum btree_evict);
+
+/**	Same as btree_insert and btree_find, through the pool. Pages are read
+	with pread, and written with pwrite when evicted or flushed.
+	An I/O error while inserting can leave the tree damaged.
+**/
+int btree_disk_insert(struct btree_disk *, const btree_data_t);
+int btree_disk_find(struct btree_disk *, const btree_data_t);
+
+/**	Write all dirty pages and the header, then fsync. Returns 0 if all
+	written, nonzero otherwise.
+**/
+int btree_disk_flush(struct btree_disk *);
+
+/**	Flush, then free the pool and close the file. Returns flush result.
+**/
+int btree_disk_close(struct btree_disk *);
+
+#endif